@@ -136,6 +136,10 @@ void analogWrite(uint8_t, int);
 unsigned long millis(void);
 unsigned long micros(void);
 void delay(unsigned long);
+void sleepUntil(unsigned long ms);
+#if defined(CYCLE_COUNTER_TIMER)
+unsigned long cycleCount(void);
+#endif
 void delayMicroseconds(unsigned int us);
 unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
 unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout);
@@ -243,14 +247,36 @@ unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout = 10
 void tone(uint8_t _pin, unsigned int frequency, unsigned long duration = 0);
 void noTone(uint8_t _pin);
 
+// A melody is a table of notes in PROGMEM ended by a note of duration 0.
+struct ToneNote {
+  unsigned int frequency; // Hz, 0 for a rest
+  unsigned int duration;  // ms
+};
+// Plays melody in the background from the tone timer interrupt, repeat
+// times or until stopMelody() when repeat is 0. It cuts off what is
+// playing, unless queue is set: then it starts when that has finished.
+void playMelody(uint8_t _pin, const ToneNote *melody, uint8_t repeat = 1, bool queue = false);
+void stopMelody(void);
+bool melodyPlaying(void);
+
 // WMath prototypes
 long random(long);
 long random(long, long);
 void randomSeed(unsigned long);
 long map(long, long, long, long, long);
 
+#if defined(RAM_REPORT)
+#include "new.h"
+
+// Print the RAM layout and the deepest the stack has gone since reset.
+void ramReport(Print &out);
+#endif
+
 #endif
 
 #include "pins_arduino.h"
+#include "Profile.h"
+#include "CoreScheduler.h"
+#include "CoreSoftTimer.h"
 
 #endif
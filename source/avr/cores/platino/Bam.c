@@ -0,0 +1,207 @@
+/*
+  Bam.c - Bit angle modulation for LEDs on any pin
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "wiring_private.h"
+#include "Bam.h"
+
+// Without HAVE_BAM this compiles to nothing, and Bam.h turns a call to
+// bamWrite() into a compile error instead.
+#if defined(HAVE_BAM)
+
+#if BAM_CHANNELS > 127 || BAM_PORTS > 127
+#error "BAM_CHANNELS and BAM_PORTS must be 127 or less"
+#endif
+
+// Timer 1 runs at F_CPU/8, so this is the bit 0 slot in timer ticks.
+#define BAM_UNIT ((uint16_t)(microsecondsToClockCycles(BAM_UNIT_US) / 8))
+
+// (i/255)^2.8*255
+static const uint8_t PROGMEM bam_gamma[256] = {
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+	  1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+	  2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+	  5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+	 10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+	 17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+	 25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+	 37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+	 51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+	 69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+	 90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+	115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+	144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+	177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+	215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255,
+};
+
+static uint8_t bam_channels;
+static uint8_t bam_pin[BAM_CHANNELS];
+static uint8_t bam_channel_port[BAM_CHANNELS];
+static uint8_t bam_ports;
+static volatile uint8_t *bam_port[BAM_PORTS];
+// The pins of each port that the interrupt owns.
+static volatile uint8_t bam_port_mask[BAM_PORTS];
+// What each port's pins look like during each slot.
+static volatile uint8_t bam_slot_bits[8][BAM_PORTS];
+static uint8_t bam_slot;
+
+ISR(TIMER1_COMPA_vect)
+{
+	uint8_t slot = bam_slot;
+	uint16_t next = OCR1A + (BAM_UNIT << slot);
+
+	// After a long interrupt the next compare may already have passed,
+	// which would cost a whole timer wrap. Stretch the slot instead.
+	if ((int16_t)(next - TCNT1) <= 0)
+		next = TCNT1 + 4;
+	OCR1A = next;
+
+	for (uint8_t p = 0; p < bam_ports; p++) {
+		volatile uint8_t *port = bam_port[p];
+		*port = (*port & ~bam_port_mask[p]) | bam_slot_bits[slot][p];
+	}
+	bam_slot = (slot + 1) & 7;
+}
+
+static void bam_start(void)
+{
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11);
+	OCR1A = TCNT1 + BAM_UNIT;
+	TIFR1 = _BV(OCF1A);
+	sbi(TIMSK1, OCIE1A);
+}
+
+// Back to the 8 bit phase correct PWM that init() sets up.
+static void bam_stop(void)
+{
+	cbi(TIMSK1, OCIE1A);
+	TCCR1B = 0;
+	TCCR1A = _BV(WGM10);
+#if F_CPU >= 8000000L
+	TCCR1B = _BV(CS11) | _BV(CS10);
+#else
+	TCCR1B = _BV(CS11);
+#endif
+}
+
+static int8_t bam_find(uint8_t pin)
+{
+	for (uint8_t i = 0; i < bam_channels; i++) {
+		if (bam_pin[i] == pin)
+			return i;
+	}
+	return -1;
+}
+
+static int8_t bam_attach(uint8_t pin)
+{
+	uint8_t port = digitalPinToPort(pin);
+	if (port == NOT_A_PIN || bam_channels == BAM_CHANNELS)
+		return -1;
+	volatile uint8_t *out = portOutputRegister(port);
+
+	uint8_t p;
+	for (p = 0; p < bam_ports; p++) {
+		if (bam_port[p] == out)
+			break;
+	}
+	if (p == bam_ports) {
+		if (bam_ports == BAM_PORTS)
+			return -1;
+		// set up the entry before the interrupt can see it
+		bam_port[p] = out;
+		bam_port_mask[p] = 0;
+		for (uint8_t slot = 0; slot < 8; slot++)
+			bam_slot_bits[slot][p] = 0;
+		bam_ports = p + 1;
+	}
+
+	pinMode(pin, OUTPUT);
+
+	uint8_t ch = bam_channels;
+	bam_pin[ch] = pin;
+	bam_channel_port[ch] = p;
+	bam_channels = ch + 1;
+
+	uint8_t oldSREG = SREG;
+	cli();
+	bam_port_mask[p] |= digitalPinToBitMask(pin);
+	if (ch == 0)
+		bam_start();
+	SREG = oldSREG;
+	return ch;
+}
+
+uint8_t bamWrite(uint8_t pin, uint8_t value)
+{
+	return bamWriteRaw(pin, pgm_read_byte(bam_gamma + value));
+}
+
+uint8_t bamWriteRaw(uint8_t pin, uint8_t duty)
+{
+	int8_t ch = bam_find(pin);
+	if (ch < 0) {
+		ch = bam_attach(pin);
+		if (ch < 0)
+			return 0;
+	}
+
+	// One byte store per slot, the interrupt only reads these, so at
+	// worst one frame mixes the old and the new duty cycle.
+	uint8_t p = bam_channel_port[ch];
+	uint8_t mask = digitalPinToBitMask(pin);
+	for (uint8_t slot = 0; slot < 8; slot++) {
+		uint8_t bits = bam_slot_bits[slot][p];
+		if (duty & (1 << slot))
+			bits |= mask;
+		else
+			bits &= ~mask;
+		bam_slot_bits[slot][p] = bits;
+	}
+	return 1;
+}
+
+void bamRelease(uint8_t pin)
+{
+	int8_t ch = bam_find(pin);
+	if (ch < 0)
+		return;
+
+	uint8_t p = bam_channel_port[ch];
+	uint8_t mask = digitalPinToBitMask(pin);
+	uint8_t oldSREG = SREG;
+	cli();
+	bam_port_mask[p] &= ~mask;
+	for (uint8_t slot = 0; slot < 8; slot++)
+		bam_slot_bits[slot][p] &= ~mask;
+	*bam_port[p] &= ~mask;
+
+	// keep the channel table packed
+	bam_channels--;
+	bam_pin[ch] = bam_pin[bam_channels];
+	bam_channel_port[ch] = bam_channel_port[bam_channels];
+	if (bam_channels == 0) {
+		bam_stop();
+		bam_ports = 0;
+	}
+	SREG = oldSREG;
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+  Bam.h - Bit angle modulation for LEDs on any pin
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef Bam_h
+#define Bam_h
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+// 8 bit brightness on pins without a PWM channel. A frame is split in 8
+// slots of 1, 2, 4 ... 128 units of BAM_UNIT_US, and in slot n a pin is
+// on when bit n of its duty cycle is set. The timer 1 compare A interrupt
+// runs once per slot, so 8 times per frame whatever the resolution, and
+// writes every port the pins are on once with a precomputed pattern.
+// While any pin is driven timer 1 runs in normal mode: analogWrite() on
+// its pins, Servo and CYCLE_COUNTER_TIMER 1 can't be used at the same time.
+
+// Up to BAM_CHANNELS pins on up to BAM_PORTS different ports.
+#if !defined(BAM_CHANNELS)
+#define BAM_CHANNELS 8
+#endif
+#if !defined(BAM_PORTS)
+#define BAM_PORTS 3
+#endif
+// Length of the shortest slot, a frame is 255 of them (245 Hz at 16 us).
+#if !defined(BAM_UNIT_US)
+#define BAM_UNIT_US 16
+#endif
+
+// Needs timer 1 with its own interrupt mask, not on the ATmega8/16/32, and
+// not while timer 1 is the cycle counter. Without it the core still builds,
+// only a sketch that calls bamWrite() or bamWriteRaw() fails to compile.
+#if defined(TIMSK1) && defined(TIFR1) && defined(OCR1A)
+#if defined(CYCLE_COUNTER_TIMER) && CYCLE_COUNTER_TIMER == 1
+#define BAM_UNAVAILABLE __attribute__((error("Bit angle modulation needs timer 1, pick another CYCLE_COUNTER_TIMER")))
+#else
+#define HAVE_BAM
+#define BAM_UNAVAILABLE
+#endif
+#else
+#define BAM_UNAVAILABLE __attribute__((error("Bit angle modulation needs timer 1 with its own interrupt mask")))
+#endif
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Drives pin at the given brightness, gamma corrected so that equal steps
+// look equal. The first call for a pin takes it over, returns false when
+// there is no room for it.
+uint8_t bamWrite(uint8_t pin, uint8_t value) BAM_UNAVAILABLE;
+// Same without gamma correction, duty is the on time in 255ths.
+uint8_t bamWriteRaw(uint8_t pin, uint8_t duty) BAM_UNAVAILABLE;
+// Gives pin back, low. Weak so that code that may share a pin with the
+// engine can call it through a null check without linking it in.
+void bamRelease(uint8_t pin) __attribute__((weak));
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,153 @@
+/*
+  CoreScheduler.c - Cooperative scheduler for periodic tasks
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "wiring_private.h"
+#include "CoreScheduler.h"
+
+struct scheduler_task {
+	void (*run)(void);
+	unsigned long period;
+	unsigned long deadline;
+	struct scheduler_stats stats;
+};
+
+static struct scheduler_task tasks[SCHEDULER_TASKS];
+
+// earliest deadline, valid when there is at least one task
+static unsigned long scheduler_next;
+
+// Looks up the earliest deadline and hands it to the timer 0 overflow
+// interrupt, which sets scheduler_due once it has passed.
+static void scheduler_arm(void)
+{
+	uint8_t armed = 0;
+	unsigned long next = 0;
+	uint8_t i;
+
+	for (i = 0; i < SCHEDULER_TASKS; i++) {
+		if (tasks[i].run && (!armed || (long)(tasks[i].deadline - next) < 0)) {
+			next = tasks[i].deadline;
+			armed = 1;
+		}
+	}
+	scheduler_next = next;
+
+	uint8_t oldSREG = SREG;
+	cli();
+	scheduler_deadline = next;
+	scheduler_armed = armed;
+	// the interrupt only looks when millis() moves on
+	if (armed && (long)(timer0_millis - next) >= 0)
+		scheduler_due = 1;
+	SREG = oldSREG;
+}
+
+int8_t schedulerAdd(void (*task)(void), unsigned long period, unsigned long delay)
+{
+	int8_t id;
+
+	for (id = 0; id < SCHEDULER_TASKS; id++) {
+		if (!tasks[id].run) {
+			tasks[id].period = period;
+			tasks[id].deadline = millis() + delay;
+			memset(&tasks[id].stats, 0, sizeof(tasks[id].stats));
+			tasks[id].run = task;
+			scheduler_arm();
+			return id;
+		}
+	}
+	return -1;
+}
+
+void schedulerRemove(int8_t id)
+{
+	if (id < 0 || id >= SCHEDULER_TASKS)
+		return;
+	tasks[id].run = NULL;
+	scheduler_arm();
+}
+
+void schedulerRun(void)
+{
+	// a task that calls delay() gets here again through yield()
+	static uint8_t running = 0;
+
+	if (!scheduler_due || running)
+		return;
+	running = 1;
+	scheduler_due = 0;
+
+	// Only what was due on entry runs, and at most SCHEDULER_TASKS tasks:
+	// a task that takes longer than its period is due again by the time it
+	// returns, and must not keep loop() from running. It waits for the next
+	// call instead, and the periods it misses count as overruns.
+	unsigned long start = millis();
+	uint8_t n;
+
+	for (n = 0; n < SCHEDULER_TASKS; n++) {
+		struct scheduler_task *t = NULL;
+		uint8_t i;
+
+		for (i = 0; i < SCHEDULER_TASKS; i++) {
+			struct scheduler_task *c = &tasks[i];
+			if (c->run && (long)(start - c->deadline) >= 0 &&
+			    (!t || (long)(c->deadline - t->deadline) < 0))
+				t = c;
+		}
+		if (!t)
+			break;
+
+		unsigned long now = millis();
+		void (*run)(void) = t->run;
+		unsigned long late = now - t->deadline;
+		if (late > t->stats.max_late)
+			t->stats.max_late = late > 0xFFFF ? 0xFFFF : late;
+		t->stats.runs++;
+
+		if (t->period == 0) {
+			t->run = NULL;
+		} else {
+			t->deadline += t->period;
+			if ((long)(now - t->deadline) >= 0) {
+				// more than a period late, skip what was missed
+				unsigned long missed = (now - t->deadline) / t->period + 1;
+				t->deadline += missed * t->period;
+				t->stats.overruns += missed;
+			}
+		}
+		run();
+	}
+
+	scheduler_arm();
+	running = 0;
+}
+
+unsigned long schedulerNextDeadline(void)
+{
+	if (!scheduler_armed)
+		return 0xFFFFFFFFUL;
+	long left = (long)(scheduler_next - millis());
+	return left > 0 ? left : 0;
+}
+
+void schedulerStats(int8_t id, struct scheduler_stats *stats)
+{
+	if (id < 0 || id >= SCHEDULER_TASKS)
+		return;
+	*stats = tasks[id].stats;
+}
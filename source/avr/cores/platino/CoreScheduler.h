@@ -0,0 +1,68 @@
+/*
+  CoreScheduler.h - Cooperative scheduler for periodic tasks
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef CoreScheduler_h
+#define CoreScheduler_h
+
+#include <inttypes.h>
+
+// Tasks run from yield() (so also while in delay()) and after every
+// loop(), never from an interrupt, in the order of their deadlines. The
+// timer 0 overflow interrupt only flags that the earliest deadline has
+// come, so schedulerRun() costs next to nothing when no task is due.
+// A task that runs more than a period late counts as an overrun and
+// skips the periods it missed instead of running several times in a row.
+// One schedulerRun() only runs the tasks that were due when it started,
+// so loop() still gets its turn when the tasks take all the time.
+//
+// Arduino.h includes this header, hence the name: a core Scheduler.h
+// would hide the Scheduler library from sketches.
+
+// Size of the task table, it is allocated statically.
+#if !defined(SCHEDULER_TASKS)
+#define SCHEDULER_TASKS 8
+#endif
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+struct scheduler_stats {
+  uint16_t runs;
+  uint16_t overruns;   // periods skipped because the task ran too late
+  uint16_t max_late;   // ms between deadline and start, worst case
+};
+
+// Runs task every period ms, the first time delay ms from now. A period
+// of 0 runs it only once. Returns the task id, or -1 when the table is
+// full.
+int8_t schedulerAdd(void (*task)(void), unsigned long period, unsigned long delay);
+void schedulerRemove(int8_t id);
+// Runs the tasks that are due, called by yield() and main(). Weak so that
+// the scheduler is only linked in when a sketch adds a task.
+void schedulerRun(void) __attribute__((weak));
+// ms until the earliest deadline, 0 when a task is due, 0xFFFFFFFF when
+// there are no tasks
+unsigned long schedulerNextDeadline(void);
+void schedulerStats(int8_t id, struct scheduler_stats *stats);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
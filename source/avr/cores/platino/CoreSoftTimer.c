@@ -0,0 +1,223 @@
+/*
+  CoreSoftTimer.c - Timer wheel for one-shot and periodic callbacks
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "wiring_private.h"
+#include "CoreSoftTimer.h"
+
+#if (SOFTTIMER_SLOTS & (SOFTTIMER_SLOTS - 1)) || SOFTTIMER_SLOTS > 256
+#error "SOFTTIMER_SLOTS must be a power of two of at most 256"
+#endif
+#if SOFTTIMER_POOL > 127
+#error "SOFTTIMER_POOL must be 127 or less"
+#endif
+
+#define NONE 0xFF
+
+// node states
+#define FREE 0
+#define ACTIVE 1     // in a wheel slot, counted in softtimer_active
+#define CANCELLED 2  // cancelled while on the pending list
+#define DONE 3       // one-shot that fired and waits on the pending list
+
+struct softtimer {
+	unsigned long expires;
+	unsigned long period;
+	void (*callback)(void *);
+	void *arg;
+	uint8_t next;       // wheel slot list, doubly linked for O(1) cancel,
+	uint8_t prev;       // and the free list
+	uint8_t pending;    // pending list, NONE is the end
+	uint8_t state : 2;
+	uint8_t in_isr : 1;
+	uint8_t is_pending : 1;
+};
+
+static struct softtimer timers[SOFTTIMER_POOL];
+static uint8_t slots[SOFTTIMER_SLOTS];
+static uint8_t free_list = NONE;
+static uint8_t pending_head = NONE, pending_tail = NONE;
+static uint8_t initialized = 0;
+// last millisecond whose slot has been processed
+static unsigned long wheel_now;
+
+// All of the list handling below runs with interrupts disabled.
+
+static void wheel_insert(uint8_t i)
+{
+	struct softtimer *t = &timers[i];
+	uint8_t *slot = &slots[t->expires & (SOFTTIMER_SLOTS - 1)];
+
+	t->prev = NONE;
+	t->next = *slot;
+	if (*slot != NONE)
+		timers[*slot].prev = i;
+	*slot = i;
+}
+
+static void wheel_remove(uint8_t i)
+{
+	struct softtimer *t = &timers[i];
+
+	if (t->prev != NONE)
+		timers[t->prev].next = t->next;
+	else
+		slots[t->expires & (SOFTTIMER_SLOTS - 1)] = t->next;
+	if (t->next != NONE)
+		timers[t->next].prev = t->prev;
+}
+
+static void pending_push(uint8_t i)
+{
+	timers[i].pending = NONE;
+	timers[i].is_pending = 1;
+	if (pending_tail != NONE)
+		timers[pending_tail].pending = i;
+	else
+		pending_head = i;
+	pending_tail = i;
+}
+
+static void free_push(uint8_t i)
+{
+	timers[i].state = FREE;
+	timers[i].next = free_list;
+	free_list = i;
+}
+
+// Processes the slots of every millisecond up to ms, millis() sometimes
+// moves on by 2. Each slot list is short when the timers are spread out,
+// timers that are a whole turn of the wheel or more away stay put.
+void softtimer_tick(unsigned long ms)
+{
+	while (wheel_now != ms) {
+		wheel_now++;
+		uint8_t i = slots[wheel_now & (SOFTTIMER_SLOTS - 1)];
+		while (i != NONE) {
+			struct softtimer *t = &timers[i];
+			uint8_t next = t->next;
+			if (t->expires == wheel_now) {
+				wheel_remove(i);
+				if (t->period) {
+					t->expires += t->period;
+					wheel_insert(i);
+				} else {
+					t->state = DONE;
+					softtimer_active--;
+				}
+				if (t->in_isr) {
+					t->callback(t->arg);
+					if (t->state == DONE)
+						free_push(i);
+					// the callback may have started or cancelled
+					// timers, so start over, the ones done so far
+					// don't expire now anymore
+					next = slots[wheel_now & (SOFTTIMER_SLOTS - 1)];
+				} else if (!t->is_pending) {
+					pending_push(i);
+				}
+			}
+			i = next;
+		}
+	}
+}
+
+int8_t softTimerStart(void (*callback)(void *), void *arg,
+                      unsigned long delay, unsigned long period, uint8_t flags)
+{
+	uint8_t oldSREG = SREG;
+	cli();
+
+	if (!initialized) {
+		uint8_t i;
+		for (i = 0; i < SOFTTIMER_SLOTS - 1; i++)
+			slots[i] = NONE;
+		slots[i] = NONE;
+		for (i = 0; i < SOFTTIMER_POOL; i++)
+			free_push(i);
+		initialized = 1;
+	}
+	// the interrupt doesn't move the wheel on while there are no timers
+	if (!softtimer_active)
+		wheel_now = timer0_millis;
+
+	uint8_t i = free_list;
+	if (i == NONE) {
+		SREG = oldSREG;
+		return -1;
+	}
+	free_list = timers[i].next;
+
+	struct softtimer *t = &timers[i];
+	t->callback = callback;
+	t->arg = arg;
+	t->period = period;
+	// a delay of 0 fires at the next tick
+	t->expires = wheel_now + (delay ? delay : 1);
+	t->in_isr = flags & SOFTTIMER_IN_ISR;
+	t->is_pending = 0;
+	t->state = ACTIVE;
+	wheel_insert(i);
+	softtimer_active++;
+
+	SREG = oldSREG;
+	return i;
+}
+
+void softTimerCancel(int8_t id)
+{
+	if (id < 0 || id >= SOFTTIMER_POOL)
+		return;
+
+	uint8_t oldSREG = SREG;
+	cli();
+	struct softtimer *t = &timers[id];
+	if (t->state == ACTIVE) {
+		wheel_remove(id);
+		softtimer_active--;
+	}
+	if (t->state != FREE) {
+		if (t->is_pending)
+			t->state = CANCELLED;  // softTimerRun() frees it
+		else
+			free_push(id);
+	}
+	SREG = oldSREG;
+}
+
+void softTimerRun(void)
+{
+	while (pending_head != NONE) {
+		uint8_t oldSREG = SREG;
+		cli();
+		uint8_t i = pending_head;
+		struct softtimer *t = &timers[i];
+		pending_head = t->pending;
+		if (pending_head == NONE)
+			pending_tail = NONE;
+		t->is_pending = 0;
+		uint8_t state = t->state;
+		void (*callback)(void *) = t->callback;
+		void *arg = t->arg;
+		if (state != ACTIVE)
+			free_push(i);
+		SREG = oldSREG;
+
+		if (state != CANCELLED)
+			callback(arg);
+	}
+}
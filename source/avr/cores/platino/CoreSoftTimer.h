@@ -0,0 +1,72 @@
+/*
+  CoreSoftTimer.h - Timer wheel for one-shot and periodic callbacks
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef CoreSoftTimer_h
+#define CoreSoftTimer_h
+
+#include <inttypes.h>
+
+// Millisecond timers for timeouts, retries, blink patterns and the like.
+// They live in a hashed wheel of SOFTTIMER_SLOTS lists that the timer 0
+// overflow interrupt walks one slot per millisecond, so starting and
+// cancelling a timer takes constant time and a tick only looks at the
+// timers that hash to the current slot. Timers come from a fixed pool of
+// SOFTTIMER_POOL, there is no malloc.
+//
+// Arduino.h includes this header, so it is not called SoftTimer.h, which
+// would hide the SoftTimer library.
+
+#if !defined(SOFTTIMER_POOL)
+#define SOFTTIMER_POOL 16
+#endif
+// Must be a power of two, ideally larger than the usual timeouts in ms
+#if !defined(SOFTTIMER_SLOTS)
+#define SOFTTIMER_SLOTS 32
+#endif
+
+// Flags for softTimerStart(): call the callback from the timer interrupt
+// (keep it short), or later from softTimerRun(), which yield() and main()
+// call after every loop().
+#define SOFTTIMER_DEFERRED 0
+#define SOFTTIMER_IN_ISR 1
+
+// For libraries that also build with cores that don't have these timers
+#define HAVE_CORE_SOFTTIMER
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Calls callback(arg) delay ms from now and then every period ms, or only
+// once when period is 0. Returns the timer id, or -1 when the pool is
+// used up. A one-shot timer is free again once its callback has run.
+int8_t softTimerStart(void (*callback)(void *), void *arg,
+                      unsigned long delay, unsigned long period, uint8_t flags);
+// Stops a timer, a deferred callback that is already due won't run.
+void softTimerCancel(int8_t id);
+// Runs the deferred callbacks that are due. Weak so that the timer code
+// is only linked in when a sketch starts a timer.
+void softTimerRun(void) __attribute__((weak));
+// Called from the timer 0 overflow interrupt with the new millis()
+void softtimer_tick(unsigned long ms) __attribute__((weak));
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
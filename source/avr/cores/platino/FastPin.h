@@ -0,0 +1,270 @@
+/*
+  FastPin.h - Single instruction pin access for pins known at compile time
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef FastPin_h
+#define FastPin_h
+
+// FastPin<N> looks up the port, bit and timer of digital pin N while
+// compiling, with the fastPinPort(), fastPinBit() and fastPinTimer() macros
+// of the variant's pins_arduino.h, instead of reading the tables in flash
+// like digitalWrite() does every time. With the register and the bit both
+// constant, high() and low() become one sbi or cbi, read() one sbic or sbis
+// and toggle() one write to the PINx register, which flips the pins that are
+// set in it. Because sbi and cbi are atomic, none of them has to turn
+// interrupts off.
+//
+//   FastPin<13> led;
+//   led.output();
+//   led.toggle();
+//
+// Unlike digitalWrite(), high() and low() leave PWM alone: output() turns it
+// off once instead. RuntimePin does the same for a pin number that is only
+// known at run time; it reads the tables once, in its constructor.
+//
+// Cycles for one write at 16 MHz, from the instruction timings of the code
+// each one compiles to (interrupts and call overhead not included):
+//
+//   digitalWrite(13, HIGH)     about 60   table lookups, PWM check, cli
+//   RuntimePin::high()               9    ld, or, st inside cli
+//   FastPin<13>::high()              2    sbi
+//   FastPin<13>::toggle()            2    ldi, out PINB
+//   FastPin<13>::read()              2    sbic/sbis plus a skipped move
+//
+// FastPort<'B'> gives the same kind of access to all eight bits of a port.
+//
+// Arduino.h doesn't include this header, a sketch that wants it does
+//
+//   #include <FastPin.h>
+//
+// so that the names don't get in the way of libraries with their own
+// FastPin, like FastLED.
+
+#include "Arduino.h"
+
+#if defined(__cplusplus) && defined(fastPinPort)
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// The oldest parts can not toggle a pin by writing its PINx bit.
+#if defined(__AVR_ATmega8__) || defined(__AVR_ATmega8A__) || \
+  defined(__AVR_ATmega16__) || defined(__AVR_ATmega16A__) || \
+  defined(__AVR_ATmega32__) || defined(__AVR_ATmega32A__)
+#define FASTPORT_TOGGLE_BY_XOR
+#endif
+
+// Same as turnOffPWM() in wiring_digital.c. With a constant timer the switch
+// folds away to a single cbi, or to nothing for NOT_ON_TIMER.
+static inline void fastPinPwmOff(uint8_t timer) __attribute__((always_inline));
+static inline void fastPinPwmOff(uint8_t timer)
+{
+  switch (timer)
+  {
+    #if defined(TCCR1A) && defined(COM1A1)
+    case TIMER1A:  TCCR1A &= ~_BV(COM1A1);  break;
+    #endif
+    #if defined(TCCR1A) && defined(COM1B1)
+    case TIMER1B:  TCCR1A &= ~_BV(COM1B1);  break;
+    #endif
+    #if defined(TCCR1A) && defined(COM1C1)
+    case TIMER1C:  TCCR1A &= ~_BV(COM1C1);  break;
+    #endif
+
+    #if defined(TCCR2) && defined(COM21)
+    case TIMER2:   TCCR2 &= ~_BV(COM21);    break;
+    #endif
+
+    #if defined(TCCR0A) && defined(COM0A1)
+    case TIMER0A:  TCCR0A &= ~_BV(COM0A1);  break;
+    #endif
+    #if defined(TCCR0A) && defined(COM0B1)
+    case TIMER0B:  TCCR0A &= ~_BV(COM0B1);  break;
+    #endif
+    #if defined(TCCR2A) && defined(COM2A1)
+    case TIMER2A:  TCCR2A &= ~_BV(COM2A1);  break;
+    #endif
+    #if defined(TCCR2A) && defined(COM2B1)
+    case TIMER2B:  TCCR2A &= ~_BV(COM2B1);  break;
+    #endif
+
+    #if defined(TCCR3A) && defined(COM3A1)
+    case TIMER3A:  TCCR3A &= ~_BV(COM3A1);  break;
+    #endif
+    #if defined(TCCR3A) && defined(COM3B1)
+    case TIMER3B:  TCCR3A &= ~_BV(COM3B1);  break;
+    #endif
+    #if defined(TCCR4A) && defined(COM4A1)
+    case TIMER4A:  TCCR4A &= ~_BV(COM4A1);  break;
+    #endif
+    #if defined(TCCR4A) && defined(COM4B1)
+    case TIMER4B:  TCCR4A &= ~_BV(COM4B1);  break;
+    #endif
+  }
+}
+
+// Changes the bits in mask to those of value. One constant bit compiles to
+// sbi or cbi, anything else is a read-modify-write that has to be protected
+// from interrupt handlers writing to the same port.
+static inline void fastPortModify(volatile uint8_t &reg, uint8_t mask, uint8_t value) __attribute__((always_inline));
+static inline void fastPortModify(volatile uint8_t &reg, uint8_t mask, uint8_t value)
+{
+  if (__builtin_constant_p(mask) && __builtin_constant_p(value) && (mask & (mask - 1)) == 0) {
+    if (value)
+      reg |= mask;
+    else
+      reg &= ~mask;
+  } else {
+    uint8_t oldSREG = SREG;
+    cli();
+    reg = (reg & ~mask) | (value & mask);
+    SREG = oldSREG;
+  }
+}
+
+static inline void fastPortToggle(volatile uint8_t &out, volatile uint8_t &in, uint8_t mask) __attribute__((always_inline));
+static inline void fastPortToggle(volatile uint8_t &out, volatile uint8_t &in, uint8_t mask)
+{
+#if defined(FASTPORT_TOGGLE_BY_XOR)
+  uint8_t oldSREG = SREG;
+  cli();
+  out ^= mask;
+  SREG = oldSREG;
+  (void)&in;
+#else
+  in = mask;
+  (void)&out;
+#endif
+}
+
+template<char P> struct FastPort;
+
+// All the ports of the supported parts are in the low I/O space, where a
+// single bit of PORTx or DDRx can be set or cleared with sbi or cbi.
+#define FASTPORT(P, PORTX, DDRX, PINX) \
+template<> struct FastPort<P> \
+{ \
+  static inline volatile uint8_t &out(void) { return PORTX; } \
+  static inline volatile uint8_t &ddr(void) { return DDRX; } \
+  static inline volatile uint8_t &in(void) { return PINX; } \
+  static inline uint8_t read(void) { return PINX; } \
+  static inline void write(uint8_t value) { PORTX = value; } \
+  static inline void mode(uint8_t outputs) { DDRX = outputs; } \
+  static inline void set(uint8_t mask) { fastPortModify(PORTX, mask, mask); } \
+  static inline void clear(uint8_t mask) { fastPortModify(PORTX, mask, 0); } \
+  static inline void toggle(uint8_t mask) { fastPortToggle(PORTX, PINX, mask); } \
+};
+
+#if defined(PORTA)
+FASTPORT('A', PORTA, DDRA, PINA)
+#endif
+#if defined(PORTB)
+FASTPORT('B', PORTB, DDRB, PINB)
+#endif
+#if defined(PORTC)
+FASTPORT('C', PORTC, DDRC, PINC)
+#endif
+#if defined(PORTD)
+FASTPORT('D', PORTD, DDRD, PIND)
+#endif
+#if defined(PORTE)
+FASTPORT('E', PORTE, DDRE, PINE)
+#endif
+
+#undef FASTPORT
+
+template<uint8_t N> struct FastPin
+{
+  // The core is built as C++98, so no static_assert: a pin number past
+  // the end makes this array size negative.
+  typedef char no_such_pin_on_this_board[(N < NUM_DIGITAL_PINS) ? 1 : -1];
+
+  enum { port = fastPinPort(N), mask = _BV(fastPinBit(N)), timer = fastPinTimer(N) };
+  typedef FastPort<port> Port;
+
+  static inline void high(void) { Port::out() |= mask; }
+  static inline void low(void) { Port::out() &= ~mask; }
+  static inline void write(uint8_t value) { if (value) high(); else low(); }
+  static inline void toggle(void) { Port::toggle(mask); }
+  static inline uint8_t read(void) { return (Port::in() & mask) ? HIGH : LOW; }
+
+  static inline void output(void) { fastPinPwmOff(timer); Port::ddr() |= mask; }
+  static inline void input(void) { Port::ddr() &= ~mask; low(); }
+  static inline void inputPullup(void) { Port::ddr() &= ~mask; high(); }
+};
+
+// The fallback for a pin number that is not a constant: the registers and the
+// mask are looked up once, after that a write takes a few instructions in a
+// cli section. An invalid pin gets a dummy register, so it does no harm.
+class RuntimePin
+{
+public:
+  RuntimePin(uint8_t pin) : _pin(pin)
+  {
+    uint8_t port = digitalPinToPort(pin);
+    if (port == NOT_A_PIN) {
+      _mask = 0;
+      _out = _in = _ddr = none();
+    } else {
+      _mask = digitalPinToBitMask(pin);
+      _out = portOutputRegister(port);
+      _in = portInputRegister(port);
+      _ddr = portModeRegister(port);
+    }
+  }
+
+  inline void high(void) { modify(_out, _mask); }
+  inline void low(void) { modify(_out, 0); }
+  inline void write(uint8_t value) { modify(_out, value ? _mask : 0); }
+  inline void toggle(void) { fastPortToggle(*_out, *_in, _mask); }
+  inline uint8_t read(void) { return (*_in & _mask) ? HIGH : LOW; }
+
+  // digitalWrite() of the level the pin already has turns PWM off.
+  inline void output(void)
+  {
+    if (digitalPinToTimer(_pin) != NOT_ON_TIMER)
+      digitalWrite(_pin, (*_out & _mask) ? HIGH : LOW);
+    modify(_ddr, _mask);
+  }
+  inline void input(void) { modify(_ddr, 0); low(); }
+  inline void inputPullup(void) { modify(_ddr, 0); high(); }
+
+private:
+  inline void modify(volatile uint8_t *reg, uint8_t value)
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    *reg = (*reg & ~_mask) | value;
+    SREG = oldSREG;
+  }
+
+  static volatile uint8_t *none(void)
+  {
+    static volatile uint8_t dummy;
+    return &dummy;
+  }
+
+  uint8_t _pin;
+  uint8_t _mask;
+  volatile uint8_t *_out;
+  volatile uint8_t *_in;
+  volatile uint8_t *_ddr;
+};
+
+#endif
+
+#endif
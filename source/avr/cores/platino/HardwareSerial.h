@@ -25,8 +25,11 @@
 #define HardwareSerial_h
 
 #include <inttypes.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 
 #include "Stream.h"
+#include "Profile.h"
 
 // Define constants and variables for buffering incoming serial data.  We're
 // using a ring buffer (I think), in which head is the index of the location
@@ -34,6 +37,12 @@
 // location from which to read.
 // NOTE: a "power of 2" buffer size is reccomended to dramatically
 //       optimize all the modulo operations for ring buffers.
+// SERIAL_TX_BUFFER_SIZE and SERIAL_RX_BUFFER_SIZE set the default for all
+// ports, SERIALn_TX_BUFFER_SIZE and SERIALn_RX_BUFFER_SIZE override it for
+// port n only, f. ex. -DSERIAL1_RX_BUFFER_SIZE=512 for a GPS on Serial1.
+// When a buffer is larger than 256 bytes its index variables are 16 bits
+// wide and are only accessed with interrupts disabled outside the ISR.
+// See https://github.com/arduino/Arduino/issues/2405
 #if !defined(SERIAL_TX_BUFFER_SIZE)
 #if (RAMEND < 1000)
 #define SERIAL_TX_BUFFER_SIZE 16
@@ -48,15 +57,110 @@
 #define SERIAL_RX_BUFFER_SIZE 64
 #endif
 #endif
-#if (SERIAL_TX_BUFFER_SIZE>256)
-typedef uint16_t tx_buffer_index_t;
-#else
-typedef uint8_t tx_buffer_index_t;
+#if !defined(SERIAL0_TX_BUFFER_SIZE)
+#define SERIAL0_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
 #endif
-#if  (SERIAL_RX_BUFFER_SIZE>256)
-typedef uint16_t rx_buffer_index_t;
-#else
-typedef uint8_t rx_buffer_index_t;
+#if !defined(SERIAL0_RX_BUFFER_SIZE)
+#define SERIAL0_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL1_TX_BUFFER_SIZE)
+#define SERIAL1_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL1_RX_BUFFER_SIZE)
+#define SERIAL1_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL2_TX_BUFFER_SIZE)
+#define SERIAL2_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL2_RX_BUFFER_SIZE)
+#define SERIAL2_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL3_TX_BUFFER_SIZE)
+#define SERIAL3_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL3_RX_BUFFER_SIZE)
+#define SERIAL3_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+
+// Selects uint8_t or uint16_t as ring buffer index type for a buffer size.
+template<bool wide> struct SerialBufferIndex { typedef uint8_t type; };
+template<> struct SerialBufferIndex<true> { typedef uint16_t type; };
+
+// Loads and stores of a ring buffer index shared with an ISR. These are
+// plain accesses for 8-bit indices, 16-bit indices need interrupts off.
+static inline uint8_t _serial_index_load(const volatile uint8_t &i) { return i; }
+static inline void _serial_index_store(volatile uint8_t &i, uint8_t v) { i = v; }
+static inline uint16_t _serial_index_load(const volatile uint16_t &i)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t v = i;
+  SREG = oldSREG;
+  return v;
+}
+static inline void _serial_index_store(volatile uint16_t &i, uint16_t v)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  i = v;
+  SREG = oldSREG;
+}
+
+// Define policies for Serial.setTxPolicy(policy);
+// SERIAL_TX_BLOCK makes write(buffer, size) wait for room in the transmit
+// buffer until all bytes are queued, SERIAL_TX_NONBLOCK makes it queue as
+// much as fits and return the number of bytes actually queued.
+#define SERIAL_TX_BLOCK 0
+#define SERIAL_TX_NONBLOCK 1
+
+// Idle-line frame detection (Modbus RTU style, see setFrameGap()) times
+// the gap with the compare B unit of timer 2, in normal mode so that a new
+// compare value counts at once (in the PWM modes it only does from the next
+// timer cycle, too late for a short gap). While it is enabled timer 2
+// belongs to the serial code: no tone() and no analogWrite() on its pins.
+// It can't be combined with the watch crystal of TIMER2_32KHZ_CRYSTAL.
+#if defined(OCR2B) && defined(TIMSK2) && defined(TIFR2) && !defined(TIMER2_32KHZ_CRYSTAL)
+#define HAVE_HWSERIAL_FRAMES
+#endif
+// Number of complete frames that can be waiting to be read per port.
+#if !defined(SERIAL_FRAME_QUEUE_SIZE)
+#define SERIAL_FRAME_QUEUE_SIZE 4
+#endif
+
+// Define SERIAL_STATS as 1 in the build flags to have every port count
+// the traffic it sees and the errors it runs into, see getStats(). The
+// counters and the code that maintains them are compiled out otherwise.
+#if !defined(SERIAL_STATS)
+#define SERIAL_STATS 0
+#endif
+
+// Define SERIALn_FAST_ISR to replace the receive and data register empty
+// interrupt handlers of port n by hand written assembly versions with
+// fixed register addresses that only save the registers they use. They
+// need power of two buffer sizes of at most 256 bytes and skip the extras
+// of the C++ handlers: no statistics, frame detection, onReceive() events
+// or multi-processor address filtering on such a port, and calls of
+// onReceive(), setAddress() or setFrameGap() on it don't compile (they
+// still do through a HardwareSerial reference, and then have no effect).
+// Worst case,
+// counting 7 cycles for the interrupt response and vector jump and 4 for
+// reti:
+//   receive:             55 cycles
+//   data register empty: 61 cycles
+// One character at 2 Mbaud (8N1) takes 80 cycles at 16 MHz, and the two
+// byte receive FIFO of the USART covers the latency of one other ISR.
+
+#if SERIAL_STATS
+struct SerialStats {
+  uint32_t rx_bytes;      // bytes received into the ring buffer
+  uint32_t tx_bytes;      // bytes queued or written for sending
+  uint16_t rx_dropped;    // bytes received while the ring buffer was full
+  uint16_t overruns;      // data overruns (DOR), bytes lost in hardware
+  uint16_t frame_errors;  // frames with a bad stop bit (FE)
+  uint16_t parity_errors; // bytes dropped because of a parity error (UPE)
+  uint16_t rx_peak;       // highest fill level of the receive buffer
+  uint16_t tx_peak;       // highest fill level of the transmit buffer
+};
 #endif
 
 // Define config for Serial.begin(baud, config);
@@ -85,6 +189,14 @@ typedef uint8_t rx_buffer_index_t;
 #define SERIAL_7O2 0x3C
 #define SERIAL_8O2 0x3E
 
+// Runs the onReceive() handlers of the ports that have something for them.
+// Called from yield() and after every loop(), it is only linked in when a
+// sketch uses onReceive(). C linkage so that hooks.c can refer to it.
+extern "C" void serialEventDispatch(void) __attribute__((weak));
+
+// Register level code that is the same for every port, whatever its
+// buffer sizes. Sketches and libraries can keep using HardwareSerial& or
+// HardwareSerial* to refer to any of the Serialx objects.
 class HardwareSerial : public Stream
 {
   protected:
@@ -96,17 +208,37 @@ class HardwareSerial : public Stream
     volatile uint8_t * const _udr;
     // Has any byte been written to the UART since begin()
     bool _written;
+    // Behaviour of write(buffer, size) when the transmit buffer is full
+    uint8_t _tx_policy;
+    // RS-485 driver enable pin, _de_mask is 0 when there is none
+    volatile uint8_t *_de_port;
+    uint8_t _de_mask;
+    // Multi-processor communication mode, only address frames carrying
+    // _mp_address wake up the receiver
+    bool _mp_slave;
+    uint8_t _mp_address;
+    // onReceive() handler, _event_bit is set in _serial_event_pending once
+    // _event_threshold bytes or the delimiter have come in. A threshold of
+    // 0 means there is no handler.
+    void (*_event_handler)(void);
+    int _event_delimiter;
+    uint8_t _event_threshold;
+    uint8_t _event_count;
+    uint8_t _event_bit;
+#if defined(HAVE_HWSERIAL_FRAMES)
+    // Idle time that ends a frame, in timer 2 ticks, 0 when disabled
+    uint16_t _frame_gap;
+    void (*_frame_callback)(void);
+#endif
+#if SERIAL_STATS
+    SerialStats _stats;
+#endif
 
-    volatile rx_buffer_index_t _rx_buffer_head;
-    volatile rx_buffer_index_t _rx_buffer_tail;
-    volatile tx_buffer_index_t _tx_buffer_head;
-    volatile tx_buffer_index_t _tx_buffer_tail;
-
-    // Don't put any members after these buffers, since only the first
-    // 32 bytes of this struct can be accessed quickly using the ldd
-    // instruction.
-    unsigned char _rx_buffer[SERIAL_RX_BUFFER_SIZE];
-    unsigned char _tx_buffer[SERIAL_TX_BUFFER_SIZE];
+#if defined(HAVE_HWSERIAL_FRAMES)
+    // setFrameGap() of HardwareSerialT, irq is called from the timer 2
+    // compare B interrupt with this port
+    void _set_frame_gap(uint8_t half_chars, void (*callback)(void), void (*irq)(HardwareSerial *));
+#endif
 
   public:
     inline HardwareSerial(
@@ -116,41 +248,202 @@ class HardwareSerial : public Stream
     void begin(unsigned long baud) { begin(baud, SERIAL_8N1); }
     void begin(unsigned long, uint8_t);
     void end();
-    virtual int available(void);
-    virtual int peek(void);
-    virtual int read(void);
-    int availableForWrite(void);
-    virtual void flush(void);
-    virtual size_t write(uint8_t);
+    virtual int availableForWrite(void) = 0;
+    virtual size_t write(uint8_t) = 0;
     inline size_t write(unsigned long n) { return write((uint8_t)n); }
     inline size_t write(long n) { return write((uint8_t)n); }
     inline size_t write(unsigned int n) { return write((uint8_t)n); }
     inline size_t write(int n) { return write((uint8_t)n); }
     using Print::write; // pull in write(str) and write(buf, size) from Print
+    void setTxPolicy(uint8_t policy) { _tx_policy = policy; }
+    // RS-485: pin is driven high from the first queued byte until the
+    // last stop bit has gone out, from the transmit complete interrupt.
+    // Pass -1 to stop using a driver enable pin.
+    void setDriverEnablePin(int pin);
+    // Multi-processor communication mode with 9-bit frames, call after
+    // begin() with an 8 data bit config. setAddress() makes this port a
+    // slave that ignores everything until an address frame with its
+    // address comes in (-1 turns this off again), writeAddress() of
+    // HardwareSerialT sends such an address frame from the master.
+    void setAddress(int address);
+    // Event driven receive: handler is run by serialEventDispatch(), from
+    // yield() (so also while in delay()) and after loop(), once threshold
+    // bytes or the delimiter byte (-1 for none) have come in since it last
+    // ran. Ports without a handler cost nothing there. Pass NULL to remove
+    // the handler. serialEvent() keeps working as before.
+    void onReceive(void (*handler)(void), uint8_t threshold = 1, int delimiter = -1);
+    friend void serialEventDispatch(void);
+#if SERIAL_STATS
+    // Copies the counters in one go, so they are consistent with each
+    // other even while the port is busy.
+    void getStats(SerialStats &stats);
+    void clearStats(void);
+#endif
     operator bool() { return true; }
+};
+
+// A port with its own receive and transmit buffers of RX_SIZE and TX_SIZE
+// bytes. Ports with the same sizes share all of their code.
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+class HardwareSerialT : public HardwareSerial
+{
+  public:
+    typedef typename SerialBufferIndex<(RX_SIZE>256)>::type rx_buffer_index_t;
+    typedef typename SerialBufferIndex<(TX_SIZE>256)>::type tx_buffer_index_t;
+
+  protected:
+    volatile rx_buffer_index_t _rx_buffer_head;
+    volatile rx_buffer_index_t _rx_buffer_tail;
+    volatile tx_buffer_index_t _tx_buffer_head;
+    volatile tx_buffer_index_t _tx_buffer_tail;
+
+#if defined(HAVE_HWSERIAL_FRAMES)
+    // Bytes received since the last gap, the number of timer 2 compare
+    // matches still to go before the gap is complete and a queue of the
+    // lengths of complete frames that have not been read yet.
+    volatile uint16_t _frame_count;
+    volatile uint8_t _frame_laps;
+    volatile uint8_t _frame_head;
+    volatile uint8_t _frame_tail;
+    volatile uint16_t _frame_len[SERIAL_FRAME_QUEUE_SIZE];
+#endif
+
+    // The buffers go last: ldd and std only reach 63 bytes past the object
+    // pointer, and members after a buffer would be further away still. The
+    // base class comes first though, so with SERIAL_STATS and the other
+    // per-port features the indices above can end up past that reach too,
+    // which costs the ISRs a few cycles to adjust the pointer.
+    unsigned char _rx_buffer[RX_SIZE];
+    unsigned char _tx_buffer[TX_SIZE];
+
+  public:
+    inline HardwareSerialT(
+      volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+      volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+      volatile uint8_t *ucsrc, volatile uint8_t *udr);
+    virtual int available(void);
+    virtual int peek(void);
+    virtual int read(void);
+    virtual int availableForWrite(void);
+    virtual void flush(void);
+    virtual size_t write(uint8_t);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using HardwareSerial::write; // pull in the other write() overloads
+    // Zero-copy receive: rxSpan() points data at the largest block of
+    // received bytes that is contiguous in the ring buffer and returns its
+    // length, consume() then drops n bytes from the front of the buffer.
+    size_t rxSpan(const uint8_t **data);
+    void consume(size_t n);
+    // Copies up to length bytes that are already buffered, without waiting.
+    size_t readAvailable(uint8_t *buffer, size_t length);
+    // Same as Stream::readBytes(), but copies what is already buffered in
+    // one go and only waits (with timeout) when nothing is available.
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    // Sends an address frame, see setAddress(). It waits until everything
+    // queued before it has gone out.
+    size_t writeAddress(uint8_t address);
+#if defined(HAVE_HWSERIAL_FRAMES)
+    // Idle-line framing: a silence of half_chars/2 character times after
+    // a received byte ends the frame (7 gives the 3.5 characters of Modbus
+    // RTU, 0 disables). Call after begin(), it uses the current baud rate
+    // and character format. callback, if given, is called from interrupt
+    // context at the end of every frame. Only one port at a time can do
+    // this, enabling it on a port disables it on the previous one.
+    void setFrameGap(uint8_t half_chars, void (*callback)(void) = NULL)
+    {
+      _set_frame_gap(half_chars, callback, _frame_gap_thunk);
+    }
+    // Length of the oldest complete frame, 0 when there is none.
+    int frameAvailable(void);
+    // Reads the oldest complete frame, returns the number of bytes stored
+    // in buffer. Bytes that don't fit in buffer are dropped.
+    size_t readFrame(uint8_t *buffer, size_t size);
+#endif
 
     // Interrupt handlers - Not intended to be called externally
     inline void _rx_complete_irq(void);
     void _tx_udr_empty_irq(void);
+    void _tx_complete_irq(void);
+    // The SERIALn_FAST_ISR versions of the first two, for naked ISRs.
+    // Register addresses are data memory addresses (_SFR_MEM_ADDR).
+    inline void _rx_complete_irq_fast(uint16_t ucsra, uint16_t udr) __attribute__((always_inline));
+    inline void _tx_udr_empty_irq_fast(uint16_t ucsra, uint16_t ucsrb, uint16_t udr) __attribute__((always_inline));
+#if SERIAL_STATS
+    void _tx_stats(size_t queued);
+#endif
+#if defined(HAVE_HWSERIAL_FRAMES)
+    void _frame_gap_irq(void);
+    static void _frame_gap_thunk(HardwareSerial *port)
+    {
+      static_cast<HardwareSerialT *>(port)->_frame_gap_irq();
+    }
+#endif
+};
+
+// The type of a SERIALn_FAST_ISR port. Its interrupt handlers leave out
+// the receive events, the address filter and the frame detection, so
+// the calls that set those up are turned into compile errors.
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+class HardwareSerialFast : public HardwareSerialT<RX_SIZE, TX_SIZE>
+{
+  public:
+    inline HardwareSerialFast(
+      volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+      volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+      volatile uint8_t *ucsrc, volatile uint8_t *udr) :
+      HardwareSerialT<RX_SIZE, TX_SIZE>(ubrrh, ubrrl, ucsra, ucsrb, ucsrc, udr) {}
+    void onReceive(void (*)(void), uint8_t = 1, int = -1)
+      __attribute__((error("onReceive() can't be used on a SERIALn_FAST_ISR port")));
+    void setAddress(int)
+      __attribute__((error("setAddress() can't be used on a SERIALn_FAST_ISR port")));
+#if defined(HAVE_HWSERIAL_FRAMES)
+    void setFrameGap(uint8_t, void (*)(void) = NULL)
+      __attribute__((error("setFrameGap() can't be used on a SERIALn_FAST_ISR port")));
+#endif
 };
 
 #if defined(UBRRH) || defined(UBRR0H)
-  extern HardwareSerial Serial;
+#if defined(SERIAL0_FAST_ISR)
+  typedef HardwareSerialFast<SERIAL0_RX_BUFFER_SIZE, SERIAL0_TX_BUFFER_SIZE> HardwareSerial0;
+#else
+  typedef HardwareSerialT<SERIAL0_RX_BUFFER_SIZE, SERIAL0_TX_BUFFER_SIZE> HardwareSerial0;
+#endif
+  extern HardwareSerial0 Serial;
   #define HAVE_HWSERIAL0
 #endif
 #if defined(UBRR1H)
-  extern HardwareSerial Serial1;
+#if defined(SERIAL1_FAST_ISR)
+  typedef HardwareSerialFast<SERIAL1_RX_BUFFER_SIZE, SERIAL1_TX_BUFFER_SIZE> HardwareSerial1;
+#else
+  typedef HardwareSerialT<SERIAL1_RX_BUFFER_SIZE, SERIAL1_TX_BUFFER_SIZE> HardwareSerial1;
+#endif
+  extern HardwareSerial1 Serial1;
   #define HAVE_HWSERIAL1
 #endif
 #if defined(UBRR2H)
-  extern HardwareSerial Serial2;
+#if defined(SERIAL2_FAST_ISR)
+  typedef HardwareSerialFast<SERIAL2_RX_BUFFER_SIZE, SERIAL2_TX_BUFFER_SIZE> HardwareSerial2;
+#else
+  typedef HardwareSerialT<SERIAL2_RX_BUFFER_SIZE, SERIAL2_TX_BUFFER_SIZE> HardwareSerial2;
+#endif
+  extern HardwareSerial2 Serial2;
   #define HAVE_HWSERIAL2
 #endif
 #if defined(UBRR3H)
-  extern HardwareSerial Serial3;
+#if defined(SERIAL3_FAST_ISR)
+  typedef HardwareSerialFast<SERIAL3_RX_BUFFER_SIZE, SERIAL3_TX_BUFFER_SIZE> HardwareSerial3;
+#else
+  typedef HardwareSerialT<SERIAL3_RX_BUFFER_SIZE, SERIAL3_TX_BUFFER_SIZE> HardwareSerial3;
+#endif
+  extern HardwareSerial3 Serial3;
   #define HAVE_HWSERIAL3
 #endif
 
 extern void serialEventRun(void) __attribute__((weak));
 
+#if defined(HAVE_HWSERIAL0) || defined(HAVE_HWSERIAL1) || defined(HAVE_HWSERIAL2) || defined(HAVE_HWSERIAL3)
+#include "HardwareSerial_impl.h"
+#endif
+
 #endif
@@ -36,38 +36,80 @@
 
 #if defined(HAVE_HWSERIAL0)
 
+#if defined(SERIAL0_FAST_ISR)
+#if (SERIAL0_RX_BUFFER_SIZE > 256) || (SERIAL0_RX_BUFFER_SIZE & (SERIAL0_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL0_TX_BUFFER_SIZE > 256) || (SERIAL0_TX_BUFFER_SIZE & (SERIAL0_TX_BUFFER_SIZE - 1))
+#error "SERIAL0_FAST_ISR needs power of two buffer sizes of at most 256 bytes"
+#endif
+#if SERIAL_STATS
+#error "SERIAL0_FAST_ISR doesn't keep statistics"
+#endif
+#define SERIAL0_ISR_FLAGS ISR_NAKED
+#else
+#define SERIAL0_ISR_FLAGS ISR_BLOCK
+#endif
+
 #if defined(USART_RX_vect)
-  ISR(USART_RX_vect)
+  ISR(USART_RX_vect, SERIAL0_ISR_FLAGS)
 #elif defined(USART0_RX_vect)
-  ISR(USART0_RX_vect)
+  ISR(USART0_RX_vect, SERIAL0_ISR_FLAGS)
 #elif defined(USART_RXC_vect)
-  ISR(USART_RXC_vect) // ATmega8
+  ISR(USART_RXC_vect, SERIAL0_ISR_FLAGS) // ATmega8
 #else
   #error "Don't know what the Data Received vector is called for Serial"
 #endif
   {
+#if defined(SERIAL0_FAST_ISR) && defined(UBRRH)
+    Serial._rx_complete_irq_fast(_SFR_MEM_ADDR(UCSRA), _SFR_MEM_ADDR(UDR));
+#elif defined(SERIAL0_FAST_ISR)
+    Serial._rx_complete_irq_fast(_SFR_MEM_ADDR(UCSR0A), _SFR_MEM_ADDR(UDR0));
+#else
     Serial._rx_complete_irq();
+#endif
   }
 
 #if defined(UART0_UDRE_vect)
-ISR(UART0_UDRE_vect)
+ISR(UART0_UDRE_vect, SERIAL0_ISR_FLAGS)
 #elif defined(UART_UDRE_vect)
-ISR(UART_UDRE_vect)
+ISR(UART_UDRE_vect, SERIAL0_ISR_FLAGS)
 #elif defined(USART0_UDRE_vect)
-ISR(USART0_UDRE_vect)
+ISR(USART0_UDRE_vect, SERIAL0_ISR_FLAGS)
 #elif defined(USART_UDRE_vect)
-ISR(USART_UDRE_vect)
+ISR(USART_UDRE_vect, SERIAL0_ISR_FLAGS)
 #else
   #error "Don't know what the Data Register Empty vector is called for Serial"
 #endif
 {
+#if defined(SERIAL0_FAST_ISR) && defined(UBRRH)
+  Serial._tx_udr_empty_irq_fast(_SFR_MEM_ADDR(UCSRA), _SFR_MEM_ADDR(UCSRB), _SFR_MEM_ADDR(UDR));
+#elif defined(SERIAL0_FAST_ISR)
+  Serial._tx_udr_empty_irq_fast(_SFR_MEM_ADDR(UCSR0A), _SFR_MEM_ADDR(UCSR0B), _SFR_MEM_ADDR(UDR0));
+#else
   Serial._tx_udr_empty_irq();
+#endif
+}
+
+#if defined(UART0_TX_vect)
+ISR(UART0_TX_vect)
+#elif defined(UART_TX_vect)
+ISR(UART_TX_vect)
+#elif defined(USART0_TX_vect)
+ISR(USART0_TX_vect)
+#elif defined(USART_TX_vect)
+ISR(USART_TX_vect)
+#elif defined(USART_TXC_vect)
+ISR(USART_TXC_vect) // ATmega8
+#else
+  #error "Don't know what the Transmit Complete vector is called for Serial"
+#endif
+{
+  Serial._tx_complete_irq();
 }
 
 #if defined(UBRRH) && defined(UBRRL)
-  HardwareSerial Serial(&UBRRH, &UBRRL, &UCSRA, &UCSRB, &UCSRC, &UDR);
+  HardwareSerial0 Serial(&UBRRH, &UBRRL, &UCSRA, &UCSRB, &UCSRC, &UDR);
 #else
-  HardwareSerial Serial(&UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0);
+  HardwareSerial0 Serial(&UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0);
 #endif
 
 // Function that can be weakly referenced by serialEventRun to prevent
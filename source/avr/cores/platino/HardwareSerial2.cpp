@@ -36,17 +36,49 @@
 
 #if defined(HAVE_HWSERIAL2)
 
-ISR(USART2_RX_vect)
+#if defined(SERIAL2_FAST_ISR)
+#if (SERIAL2_RX_BUFFER_SIZE > 256) || (SERIAL2_RX_BUFFER_SIZE & (SERIAL2_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL2_TX_BUFFER_SIZE > 256) || (SERIAL2_TX_BUFFER_SIZE & (SERIAL2_TX_BUFFER_SIZE - 1))
+#error "SERIAL2_FAST_ISR needs power of two buffer sizes of at most 256 bytes"
+#endif
+#if SERIAL_STATS
+#error "SERIAL2_FAST_ISR doesn't keep statistics"
+#endif
+#define SERIAL2_ISR_FLAGS ISR_NAKED
+#else
+#define SERIAL2_ISR_FLAGS ISR_BLOCK
+#endif
+
+ISR(USART2_RX_vect, SERIAL2_ISR_FLAGS)
 {
+#if defined(SERIAL2_FAST_ISR)
+  Serial2._rx_complete_irq_fast(_SFR_MEM_ADDR(UCSR2A), _SFR_MEM_ADDR(UDR2));
+#else
   Serial2._rx_complete_irq();
+#endif
 }
 
-ISR(USART2_UDRE_vect)
+ISR(USART2_UDRE_vect, SERIAL2_ISR_FLAGS)
 {
+#if defined(SERIAL2_FAST_ISR)
+  Serial2._tx_udr_empty_irq_fast(_SFR_MEM_ADDR(UCSR2A), _SFR_MEM_ADDR(UCSR2B), _SFR_MEM_ADDR(UDR2));
+#else
   Serial2._tx_udr_empty_irq();
+#endif
+}
+
+#if defined(UART2_TX_vect)
+ISR(UART2_TX_vect)
+#elif defined(USART2_TX_vect)
+ISR(USART2_TX_vect)
+#else
+  #error "Don't know what the Transmit Complete vector is called for Serial2"
+#endif
+{
+  Serial2._tx_complete_irq();
 }
 
-HardwareSerial Serial2(&UBRR2H, &UBRR2L, &UCSR2A, &UCSR2B, &UCSR2C, &UDR2);
+HardwareSerial2 Serial2(&UBRR2H, &UBRR2L, &UCSR2A, &UCSR2B, &UCSR2C, &UDR2);
 
 // Function that can be weakly referenced by serialEventRun to prevent
 // pulling in this file if it's not otherwise used.
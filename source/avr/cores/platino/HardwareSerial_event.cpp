@@ -0,0 +1,75 @@
+/*
+  HardwareSerial_event.cpp - Event driven receive for HardwareSerial
+  Copyright (c) 2006 Nicholas Zambetti.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+#include "HardwareSerial_private.h"
+
+// This is in its own file so that serialEventDispatch(), which main() and
+// yield() only refer to weakly, is only linked in when a sketch calls
+// onReceive().
+
+#if defined(HAVE_HWSERIAL0) || defined(HAVE_HWSERIAL1) || defined(HAVE_HWSERIAL2) || defined(HAVE_HWSERIAL3)
+
+// There are never more than 4 ports, so there is always a free slot. The
+// slot number is the bit of the port in _serial_event_pending.
+static HardwareSerial *_event_ports[4];
+
+void HardwareSerial::onReceive(void (*handler)(void), uint8_t threshold, int delimiter)
+{
+  uint8_t slot = 0;
+  while (_event_ports[slot] && _event_ports[slot] != this)
+    slot++;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  _event_ports[slot] = handler ? this : NULL;
+  _event_handler = handler;
+  _event_delimiter = delimiter;
+  _event_count = 0;
+  _event_bit = 1 << slot;
+  _event_threshold = handler ? (threshold ? threshold : 1) : 0;
+  _serial_event_pending &= ~_event_bit;
+  SREG = oldSREG;
+}
+
+void serialEventDispatch(void)
+{
+  // A handler that calls delay() gets here again through yield()
+  static bool running = false;
+
+  if (!_serial_event_pending || running)
+    return;
+  running = true;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  uint8_t pending = _serial_event_pending;
+  _serial_event_pending = 0;
+  SREG = oldSREG;
+
+  for (uint8_t slot = 0; pending; slot++, pending >>= 1) {
+    HardwareSerial *port = _event_ports[slot];
+    if ((pending & 1) && port)
+      port->_event_handler();
+  }
+  running = false;
+}
+
+#endif // whole file
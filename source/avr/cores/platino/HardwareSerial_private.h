@@ -27,60 +27,8 @@
 // this is so I can support Attiny series and any other chip without a uart
 #if defined(HAVE_HWSERIAL0) || defined(HAVE_HWSERIAL1) || defined(HAVE_HWSERIAL2) || defined(HAVE_HWSERIAL3)
 
-// Ensure that the various bit positions we use are available with a 0
-// postfix, so we can always use the values for UART0 for all UARTs. The
-// alternative, passing the various values for each UART to the
-// HardwareSerial constructor also works, but makes the code bigger and
-// slower.
-#if !defined(TXC0)
-#if defined(TXC)
-// Some chips like ATmega8 don't have UPE, only PE. The other bits are
-// named as expected.
-#if !defined(UPE) && defined(PE)
-#define UPE PE
-#endif
-// On ATmega8, the uart and its bits are not numbered, so there is no TXC0 etc.
-#define TXC0 TXC
-#define RXEN0 RXEN
-#define TXEN0 TXEN
-#define RXCIE0 RXCIE
-#define UDRIE0 UDRIE
-#define U2X0 U2X
-#define UPE0 UPE
-#define UDRE0 UDRE
-#elif defined(TXC1)
-// Some devices have uart1 but no uart0
-#define TXC0 TXC1
-#define RXEN0 RXEN1
-#define TXEN0 TXEN1
-#define RXCIE0 RXCIE1
-#define UDRIE0 UDRIE1
-#define U2X0 U2X1
-#define UPE0 UPE1
-#define UDRE0 UDRE1
-#else
-#error No UART found in HardwareSerial.cpp
-#endif
-#endif // !defined TXC0
-
-// Check at compiletime that it is really ok to use the bit positions of
-// UART0 for the other UARTs as well, in case these values ever get
-// changed for future hardware.
-#if defined(TXC1) && (TXC1 != TXC0 || RXEN1 != RXEN0 || RXCIE1 != RXCIE0 || \
-		      UDRIE1 != UDRIE0 || U2X1 != U2X0 || UPE1 != UPE0 || \
-		      UDRE1 != UDRE0)
-#error "Not all bit positions for UART1 are the same as for UART0"
-#endif
-#if defined(TXC2) && (TXC2 != TXC0 || RXEN2 != RXEN0 || RXCIE2 != RXCIE0 || \
-		      UDRIE2 != UDRIE0 || U2X2 != U2X0 || UPE2 != UPE0 || \
-		      UDRE2 != UDRE0)
-#error "Not all bit positions for UART2 are the same as for UART0"
-#endif
-#if defined(TXC3) && (TXC3 != TXC0 || RXEN3 != RXEN0 || RXCIE3 != RXCIE0 || \
-		      UDRIE3 != UDRIE0 || U3X3 != U3X0 || UPE3 != UPE0 || \
-		      UDRE3 != UDRE0)
-#error "Not all bit positions for UART3 are the same as for UART0"
-#endif
+// One bit per port with an onReceive() handler that is due to run
+extern volatile uint8_t _serial_event_pending;
 
 // Constructors ////////////////////////////////////////////////////////////////
 
@@ -91,20 +39,65 @@ HardwareSerial::HardwareSerial(
     _ubrrh(ubrrh), _ubrrl(ubrrl),
     _ucsra(ucsra), _ucsrb(ucsrb), _ucsrc(ucsrc),
     _udr(udr),
+    _tx_policy(SERIAL_TX_BLOCK),
+    _de_port(NULL), _de_mask(0),
+    _mp_slave(false), _mp_address(0),
+    _event_handler(NULL), _event_delimiter(-1),
+    _event_threshold(0), _event_count(0), _event_bit(0)
+#if defined(HAVE_HWSERIAL_FRAMES)
+    , _frame_gap(0), _frame_callback(NULL)
+#endif
+{
+#if SERIAL_STATS
+  memset(&_stats, 0, sizeof(_stats));
+#endif
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+HardwareSerialT<RX_SIZE, TX_SIZE>::HardwareSerialT(
+  volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+  volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+  volatile uint8_t *ucsrc, volatile uint8_t *udr) :
+    HardwareSerial(ubrrh, ubrrl, ucsra, ucsrb, ucsrc, udr),
     _rx_buffer_head(0), _rx_buffer_tail(0),
     _tx_buffer_head(0), _tx_buffer_tail(0)
+#if defined(HAVE_HWSERIAL_FRAMES)
+    , _frame_count(0), _frame_laps(0), _frame_head(0), _frame_tail(0)
+#endif
 {
 }
 
 // Actual interrupt handlers //////////////////////////////////////////////////////////////
 
-void HardwareSerial::_rx_complete_irq(void)
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::_rx_complete_irq(void)
 {
+  PROFILE_SCOPE(PROFILE_ID_SERIAL_RX);
+#if SERIAL_STATS
+  // The error flags belong to the byte in UDR, so look at them before
+  // reading it
+  uint8_t status = *_ucsra;
+  if (status & _BV(DOR0))
+    _stats.overruns++;
+  if (status & _BV(FE0))
+    _stats.frame_errors++;
+#endif
   if (bit_is_clear(*_ucsra, UPE0)) {
+    if (_mp_slave && bit_is_set(*_ucsrb, RXB80)) {
+      // Address frame: listen to the data frames that follow when it is
+      // ours, sleep through them otherwise. TXC is masked out of the
+      // write, a 1 there would clear a pending TX complete interrupt.
+      uint8_t ucsra = *_ucsra & (_BV(U2X0) | _BV(MPCM0));
+      if (*_udr == _mp_address)
+        *_ucsra = ucsra & ~_BV(MPCM0);
+      else
+        *_ucsra = ucsra | _BV(MPCM0);
+      return;
+    }
     // No Parity error, read byte and store it in the buffer if there is
     // room
     unsigned char c = *_udr;
-    rx_buffer_index_t i = (unsigned int)(_rx_buffer_head + 1) % SERIAL_RX_BUFFER_SIZE;
+    rx_buffer_index_t i = (unsigned int)(_rx_buffer_head + 1) % RX_SIZE;
 
     // if we should be storing the received character into the location
     // just before the tail (meaning that the head would advance to the
@@ -113,11 +106,138 @@ void HardwareSerial::_rx_complete_irq(void)
     if (i != _rx_buffer_tail) {
       _rx_buffer[_rx_buffer_head] = c;
       _rx_buffer_head = i;
+#if SERIAL_STATS
+      _stats.rx_bytes++;
+      uint16_t fill = (unsigned int)(RX_SIZE + i - _rx_buffer_tail) % RX_SIZE;
+      if (fill > _stats.rx_peak)
+        _stats.rx_peak = fill;
+#endif
+      if (_event_threshold) {
+        if (++_event_count >= _event_threshold || c == _event_delimiter) {
+          _event_count = 0;
+          _serial_event_pending |= _event_bit;
+        }
+      }
+#if defined(HAVE_HWSERIAL_FRAMES)
+      if (_frame_gap) {
+        // (Re)start the idle timer, the frame ends _frame_gap timer 2
+        // ticks from now unless another byte comes in first. Timer 2 is
+        // 8 bits, so gaps longer than 256 ticks take several matches.
+        uint16_t gap = _frame_gap;
+        _frame_count++;
+        OCR2B = TCNT2 + (uint8_t)gap;
+        _frame_laps = (gap - 1) >> 8;
+        TIFR2 = _BV(OCF2B);
+        TIMSK2 |= _BV(OCIE2B);
+      }
+#endif
     }
+#if SERIAL_STATS
+    else {
+      _stats.rx_dropped++;
+    }
+#endif
   } else {
     // Parity error, read byte but discard it
     *_udr;
+#if SERIAL_STATS
+    _stats.parity_errors++;
+#endif
   };
 }
 
+// Hand written handlers for SERIALn_FAST_ISR. The cycle counts in the
+// comments are those of the longest path through each one. Indices are 8
+// bits and the sizes powers of two, see the checks in HardwareSerialx.cpp.
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::_rx_complete_irq_fast(uint16_t ucsra, uint16_t udr)
+{
+  __asm__ __volatile__ (
+    "push r24"                     "\n\t" // 2
+    "in r24, __SREG__"             "\n\t" // 1
+    "push r24"                     "\n\t" // 2
+    "push r25"                     "\n\t" // 2
+    "push r30"                     "\n\t" // 2
+    "push r31"                     "\n\t" // 2
+    // status first, reading UDR moves the FIFO on
+    "lds r25, %[ucsra]"            "\n\t" // 2
+    "lds r24, %[udr]"              "\n\t" // 2
+    "sbrc r25, %[upe]"             "\n\t" // 2
+    "rjmp 1f"                      "\n\t" //   parity error, drop
+    "lds r25, %[head]"             "\n\t" // 2
+    "mov r30, r25"                 "\n\t" // 1
+    "inc r25"                      "\n\t" // 1
+    "andi r25, %[mask]"            "\n\t" // 1
+    "lds r31, %[tail]"             "\n\t" // 2
+    "cp r25, r31"                  "\n\t" // 1
+    "breq 1f"                      "\n\t" // 1  buffer full, drop
+    "ldi r31, 0"                   "\n\t" // 1
+    "subi r30, lo8(-(%[buf]))"     "\n\t" // 1
+    "sbci r31, hi8(-(%[buf]))"     "\n\t" // 1
+    "st Z, r24"                    "\n\t" // 2
+    "sts %[head], r25"             "\n\t" // 2
+    "1:"                           "\n\t"
+    "pop r31"                      "\n\t" // 2
+    "pop r30"                      "\n\t" // 2
+    "pop r25"                      "\n\t" // 2
+    "pop r24"                      "\n\t" // 2
+    "out __SREG__, r24"            "\n\t" // 1
+    "pop r24"                      "\n\t" // 2
+    "reti"                         "\n\t" // 4
+    :
+    : [ucsra] "n" (ucsra), [udr] "n" (udr), [upe] "I" (UPE0),
+      [head] "i" (&_rx_buffer_head), [tail] "i" (&_rx_buffer_tail),
+      [buf] "i" (_rx_buffer), [mask] "M" (RX_SIZE - 1)
+  );
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::_tx_udr_empty_irq_fast(uint16_t ucsra, uint16_t ucsrb, uint16_t udr)
+{
+  // Only enabled while there is data in the buffer, like the C++ version
+  __asm__ __volatile__ (
+    "push r24"                     "\n\t" // 2
+    "in r24, __SREG__"             "\n\t" // 1
+    "push r24"                     "\n\t" // 2
+    "push r25"                     "\n\t" // 2
+    "push r30"                     "\n\t" // 2
+    "push r31"                     "\n\t" // 2
+    "lds r30, %[tail]"             "\n\t" // 2
+    "mov r25, r30"                 "\n\t" // 1
+    "ldi r31, 0"                   "\n\t" // 1
+    "subi r30, lo8(-(%[buf]))"     "\n\t" // 1
+    "sbci r31, hi8(-(%[buf]))"     "\n\t" // 1
+    "ld r24, Z"                    "\n\t" // 2
+    "sts %[udr], r24"              "\n\t" // 2
+    "inc r25"                      "\n\t" // 1
+    "andi r25, %[mask]"            "\n\t" // 1
+    "sts %[tail], r25"             "\n\t" // 2
+    // clear TXC for flush(), as sbi(*_ucsra, TXC0) does
+    "lds r24, %[ucsra]"            "\n\t" // 2
+    "ori r24, %[txc]"              "\n\t" // 1
+    "sts %[ucsra], r24"            "\n\t" // 2
+    "lds r24, %[head]"             "\n\t" // 2
+    "cp r24, r25"                  "\n\t" // 1
+    "brne 1f"                      "\n\t" // 1
+    // buffer empty, disable this interrupt
+    "lds r24, %[ucsrb]"            "\n\t" // 2
+    "andi r24, %[udrie]"           "\n\t" // 1
+    "sts %[ucsrb], r24"            "\n\t" // 2
+    "1:"                           "\n\t"
+    "pop r31"                      "\n\t" // 2
+    "pop r30"                      "\n\t" // 2
+    "pop r25"                      "\n\t" // 2
+    "pop r24"                      "\n\t" // 2
+    "out __SREG__, r24"            "\n\t" // 1
+    "pop r24"                      "\n\t" // 2
+    "reti"                         "\n\t" // 4
+    :
+    : [ucsra] "n" (ucsra), [ucsrb] "n" (ucsrb), [udr] "n" (udr),
+      [txc] "M" (_BV(TXC0)), [udrie] "M" (0xFF & ~_BV(UDRIE0)),
+      [head] "i" (&_tx_buffer_head), [tail] "i" (&_tx_buffer_tail),
+      [buf] "i" (_tx_buffer), [mask] "M" (TX_SIZE - 1)
+  );
+}
+
 #endif // whole file
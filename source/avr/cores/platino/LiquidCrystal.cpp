@@ -26,26 +26,30 @@
 
 LiquidCrystal::LiquidCrystal(uint8_t rs, uint8_t rw, uint8_t enable,
 			     uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3,
-			     uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7)
+			     uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7) :
+  _fb(0), _fb_any(0)
 {
   init(0, rs, rw, enable, d0, d1, d2, d3, d4, d5, d6, d7);
 }
 
 LiquidCrystal::LiquidCrystal(uint8_t rs, uint8_t enable,
 			     uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3,
-			     uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7)
+			     uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7) :
+  _fb(0), _fb_any(0)
 {
   init(0, rs, 255, enable, d0, d1, d2, d3, d4, d5, d6, d7);
 }
 
 LiquidCrystal::LiquidCrystal(uint8_t rs, uint8_t rw, uint8_t enable,
-			     uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3)
+			     uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3) :
+  _fb(0), _fb_any(0)
 {
   init(1, rs, rw, enable, d0, d1, d2, d3, 0, 0, 0, 0);
 }
 
 LiquidCrystal::LiquidCrystal(uint8_t rs,  uint8_t enable,
-			     uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3)
+			     uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3) :
+  _fb(0), _fb_any(0)
 {
   init(1, rs, 255, enable, d0, d1, d2, d3, 0, 0, 0, 0);
 }
@@ -73,6 +77,32 @@ void LiquidCrystal::init(uint8_t fourbitmode, uint8_t rs, uint8_t rw, uint8_t en
     pinMode(_rw_pin, OUTPUT);
   }
   pinMode(_enable_pin, OUTPUT);
+
+  _rs_port = portOutputRegister(digitalPinToPort(_rs_pin));
+  _rs_mask = digitalPinToBitMask(_rs_pin);
+  _enable_port = portOutputRegister(digitalPinToPort(_enable_pin));
+  _enable_mask = digitalPinToBitMask(_enable_pin);
+
+  // The four data lines of 4 bit mode can be written in one go when they
+  // are consecutive bits of the same port, like PD4..PD7 on Platino.
+  _data_port = 0;
+  if (fourbitmode) {
+    uint8_t port = digitalPinToPort(d0);
+    uint8_t mask = digitalPinToBitMask(d0);
+    uint8_t shift = 0;
+    while (shift < 5 && mask != _BV(shift)) {
+      shift++;
+    }
+    if (shift < 5 &&
+        digitalPinToPort(d1) == port && digitalPinToBitMask(d1) == (mask << 1) &&
+        digitalPinToPort(d2) == port && digitalPinToBitMask(d2) == (mask << 2) &&
+        digitalPinToPort(d3) == port && digitalPinToBitMask(d3) == (mask << 3)) {
+      _data_port = portOutputRegister(port);
+      _data_ddr = portModeRegister(port);
+      _data_pin = portInputRegister(port);
+      _data_shift = shift;
+    }
+  }
   
   if (fourbitmode)
     _displayfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
@@ -83,10 +113,17 @@ void LiquidCrystal::init(uint8_t fourbitmode, uint8_t rs, uint8_t rw, uint8_t en
 }
 
 void LiquidCrystal::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
+  // the framebuffer depends on the size, set it up again at the end
+  bool fb = _fb != 0;
+  framebuffer(false);
+  // the busy flag can't be read until the interface is set up
+  _initialized = 0;
+
   if (lines > 1) {
     _displayfunction |= LCD_2LINE;
   }
   _numlines = lines;
+  _cols = cols;
 
   setRowOffsets(0x00, 0x40, 0x00 + cols, 0x40 + cols);  
 
@@ -125,6 +162,7 @@ void LiquidCrystal::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
 
     // finally, set to 4-bit interface
     write4bits(0x02); 
+    delayMicroseconds(100);
   } else {
     // this is according to the hitachi HD44780 datasheet
     // page 45 figure 23
@@ -143,6 +181,7 @@ void LiquidCrystal::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
 
   // finally, set # lines, font size, etc.
   command(LCD_FUNCTIONSET | _displayfunction);  
+  _initialized = _rw_pin != 255;
 
   // turn the display on with no cursor or blinking default
   _displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;  
@@ -156,6 +195,9 @@ void LiquidCrystal::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
   // set the entry mode
   command(LCD_ENTRYMODESET | _displaymode);
 
+  if (fb) {
+    framebuffer(true);
+  }
 }
 
 /*
@@ -175,14 +217,30 @@ void LiquidCrystal::setRowOffsets(int row0, int row1, int row2, int row3)
 /********** high level commands, for the user! */
 void LiquidCrystal::clear()
 {
+  if (_fb) {
+    _fb_pos = 0;
+    for (uint8_t i = 0; i < _cols * _numlines; i++) {
+      write(' ');
+    }
+    _fb_pos = 0;
+    return;
+  }
   command(LCD_CLEARDISPLAY);  // clear display, set cursor position to zero
-  delayMicroseconds(2000);  // this command takes a long time!
+  if (!_initialized) {
+    delayMicroseconds(2000);  // this command takes a long time!
+  }
 }
 
 void LiquidCrystal::home()
 {
+  if (_fb) {
+    _fb_pos = 0;
+    return;
+  }
   command(LCD_RETURNHOME);  // set cursor position to zero
-  delayMicroseconds(2000);  // this command takes a long time!
+  if (!_initialized) {
+    delayMicroseconds(2000);  // this command takes a long time!
+  }
 }
 
 void LiquidCrystal::setCursor(uint8_t col, uint8_t row)
@@ -194,6 +252,11 @@ void LiquidCrystal::setCursor(uint8_t col, uint8_t row)
   if ( row >= _numlines ) {
     row = _numlines - 1;    // we count rows starting w/0
   }
+
+  if (_fb) {
+    _fb_pos = row * _cols + col;
+    return;
+  }
   
   command(LCD_SETDDRAMADDR | (col + _row_offsets[row]));
 }
@@ -264,33 +327,174 @@ void LiquidCrystal::noAutoscroll(void) {
 // with custom characters
 void LiquidCrystal::createChar(uint8_t location, uint8_t charmap[]) {
   location &= 0x7; // we only have 8 locations 0-7
-  command(LCD_SETCGRAMADDR | (location << 3));
+  hold();
+  send(LCD_SETCGRAMADDR | (location << 3), LOW);
   for (int i=0; i<8; i++) {
-    write(charmap[i]);
+    send(charmap[i], HIGH);
+  }
+  _fb_hold = 0;
+}
+
+/*********** framebuffer mode */
+
+bool LiquidCrystal::framebuffer(bool true_false) {
+  if (_fb) {
+    // stop refresh() before the buffers go away
+    uint8_t oldSREG = SREG;
+    cli();
+    uint8_t *fb = _fb;
+    _fb = 0;
+    _fb_any = 0;
+    SREG = oldSREG;
+    free(fb);
+  }
+  if (!true_false) {
+    return true;
+  }
+
+  uint8_t size = _cols * _numlines;
+  uint8_t *fb = (uint8_t *)malloc(size + (size + 7) / 8);
+  if (fb == 0) {
+    return false;
+  }
+  // The display's contents are unknown, so start out with a blank
+  // screen that is entirely dirty.
+  memset(fb, ' ', size);
+  memset(fb + size, 0xFF, (size + 7) / 8);
+  _fb_dirty = fb + size;
+  _fb_pos = 0;
+  _fb_scan = 0;
+  _fb_addr = 0xFF;
+  _fb_hold = 0;
+  uint8_t oldSREG = SREG;
+  cli();
+  _fb = fb;
+  _fb_any = 1;
+  SREG = oldSREG;
+  return true;
+}
+
+// Sends one byte to the display: either the address of the next dirty
+// cell if the display isn't there yet, or the cell itself. refresh()
+// only calls this when there is something to send.
+void LiquidCrystal::refreshStep(void) {
+  if (_fb_hold) {
+    return;
+  }
+
+  uint8_t size = _cols * _numlines;
+  uint8_t i = _fb_scan;
+  for (uint8_t n = 0; ; n++) {
+    if (n == size) {
+      // nothing left, write() sets _fb_any again
+      _fb_any = 0;
+      return;
+    }
+    if (i >= size) {
+      i = 0;
+    }
+    uint8_t bits = _fb_dirty[i >> 3];
+    if (bits & _BV(i & 7)) {
+      break;
+    }
+    if (bits == 0 && (i & 7) == 0 && n + 8 <= size) {
+      // skip eight clean cells at once
+      i += 8;
+      n += 7;
+    } else {
+      i++;
+    }
+  }
+
+  uint8_t row = i / _cols;
+  uint8_t addr = _row_offsets[row] + (i - row * _cols);
+  if (addr != _fb_addr) {
+    transfer(LCD_SETDDRAMADDR | addr, LOW);
+    _fb_addr = addr;
+    _fb_scan = i;
+    return;
+  }
+  _fb_dirty[i >> 3] &= ~_BV(i & 7);
+  transfer(_fb[i], HIGH);
+  _fb_addr++;
+  _fb_scan = i + 1;
+}
+
+void LiquidCrystal::flush(void) {
+  while (_fb_any) {
+    uint8_t oldSREG = SREG;
+    cli();
+    refresh();
+    SREG = oldSREG;
+    delayMicroseconds(50);  // commands need > 37us to settle
+  }
+}
+
+// Keeps refresh() off the display while the sketch sends a command.
+// The 50us let the last byte refresh() sent settle. Clear _fb_hold
+// when done.
+void LiquidCrystal::hold(void) {
+  if (_fb) {
+    _fb_hold = 1;
+    _fb_addr = 0xFF;
+    delayMicroseconds(50);
   }
 }
 
 /*********** mid level commands, for sending data/cmds */
 
 inline void LiquidCrystal::command(uint8_t value) {
+  hold();
   send(value, LOW);
+  _fb_hold = 0;
 }
 
 inline size_t LiquidCrystal::write(uint8_t value) {
+  if (_fb) {
+    uint8_t pos = _fb_pos;
+    if (pos >= _cols * _numlines) {
+      return 0;
+    }
+    _fb_pos = pos + 1;
+    if (_fb[pos] != value) {
+      // refresh() clears dirty bits from an interrupt
+      uint8_t oldSREG = SREG;
+      cli();
+      _fb[pos] = value;
+      _fb_dirty[pos >> 3] |= _BV(pos & 7);
+      _fb_any = 1;
+      SREG = oldSREG;
+    }
+    return 1;
+  }
   send(value, HIGH);
   return 1; // assume sucess
 }
 
 /************ low level data pushing commands **********/
 
-// write either command or data, with automatic 4/8-bit selection
+// write either command or data and wait for the display to take it
 void LiquidCrystal::send(uint8_t value, uint8_t mode) {
-  digitalWrite(_rs_pin, mode);
+  if (_initialized) {
+    // with RW wired, wait exactly as long as the display needs
+    waitReady();
+    transfer(value, mode);
+  } else {
+    transfer(value, mode);
+    delayMicroseconds(100);   // commands need > 37us to settle
+  }
+}
 
-  // if there is a RW pin indicated, set it low to Write
-  if (_rw_pin != 255) { 
-    digitalWrite(_rw_pin, LOW);
+// write either command or data, with automatic 4/8-bit selection
+void LiquidCrystal::transfer(uint8_t value, uint8_t mode) {
+  uint8_t oldSREG = SREG;
+  cli();
+  if (mode) {
+    *_rs_port |= _rs_mask;
+  } else {
+    *_rs_port &= ~_rs_mask;
   }
+  SREG = oldSREG;
   
   if (_displayfunction & LCD_8BITMODE) {
     write8bits(value); 
@@ -300,24 +504,90 @@ void LiquidCrystal::send(uint8_t value, uint8_t mode) {
   }
 }
 
+// Poll the busy flag (D7) until the display has finished the last
+// command. Only possible with RW wired and after the function set.
+void LiquidCrystal::waitReady(void) {
+  uint8_t count = (_displayfunction & LCD_8BITMODE) ? 8 : 4;
+  if (_data_port) {
+    uint8_t oldSREG = SREG;
+    cli();
+    *_data_ddr &= ~(0x0F << _data_shift);
+    *_data_port &= ~(0x0F << _data_shift);
+    SREG = oldSREG;
+  } else {
+    for (int i = 0; i < count; i++) {
+      pinMode(_data_pins[i], INPUT);
+    }
+  }
+  digitalWrite(_rs_pin, LOW);
+  digitalWrite(_rw_pin, HIGH);
+
+  // Give up after a few ms, far more than the slowest command needs,
+  // in case the display is missing.
+  uint16_t timeout = 2000;
+  uint8_t busy;
+  do {
+    enable(HIGH);
+    delayMicroseconds(1);    // data is valid 360ns after E rises
+    if (_data_port) {
+      busy = *_data_pin & (0x08 << _data_shift);
+    } else {
+      busy = digitalRead(_data_pins[count - 1]);
+    }
+    enable(LOW);
+    if (count == 4) {
+      // clock out the low nibble with the address counter
+      delayMicroseconds(1);
+      enable(HIGH);
+      delayMicroseconds(1);
+      enable(LOW);
+    }
+    delayMicroseconds(1);
+  } while (busy && --timeout);
+
+  digitalWrite(_rw_pin, LOW);
+  if (!_data_port) {
+    for (int i = 0; i < count; i++) {
+      pinMode(_data_pins[i], OUTPUT);
+    }
+  }
+}
+
+void LiquidCrystal::enable(uint8_t value) {
+  uint8_t oldSREG = SREG;
+  cli();
+  if (value) {
+    *_enable_port |= _enable_mask;
+  } else {
+    *_enable_port &= ~_enable_mask;
+  }
+  SREG = oldSREG;
+}
+
 void LiquidCrystal::pulseEnable(void) {
-  digitalWrite(_enable_pin, LOW);
-  delayMicroseconds(1);    
-  digitalWrite(_enable_pin, HIGH);
+  enable(HIGH);
   delayMicroseconds(1);    // enable pulse must be >450ns
-  digitalWrite(_enable_pin, LOW);
-  delayMicroseconds(100);   // commands need > 37us to settle
+  enable(LOW);
 }
 
 void LiquidCrystal::write4bits(uint8_t value) {
-  for (int i = 0; i < 4; i++) {
-    pinMode(_data_pins[i], OUTPUT);
-    digitalWrite(_data_pins[i], (value >> i) & 0x01);
+  if (_data_port) {
+    // D4..D7 are consecutive bits of one port: a single masked store
+    uint8_t mask = 0x0F << _data_shift;
+    uint8_t oldSREG = SREG;
+    cli();
+    *_data_ddr |= mask;
+    *_data_port = (*_data_port & ~mask) | ((value << _data_shift) & mask);
+    SREG = oldSREG;
+  } else {
+    for (int i = 0; i < 4; i++) {
+      pinMode(_data_pins[i], OUTPUT);
+      digitalWrite(_data_pins[i], (value >> i) & 0x01);
+    }
   }
 
   pulseEnable();
 }
-
 void LiquidCrystal::write8bits(uint8_t value) {
   for (int i = 0; i < 8; i++) {
     pinMode(_data_pins[i], OUTPUT);
@@ -44,7 +44,7 @@
 
 class LiquidCrystal : public Print {
 public:
-  LiquidCrystal(void) {}  // CPV
+  LiquidCrystal(void) : _fb(0), _fb_any(0) {}  // CPV
   LiquidCrystal(uint8_t rs, uint8_t enable,
 		uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3,
 		uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7);
@@ -83,27 +83,61 @@ public:
   void setCursor(uint8_t, uint8_t); 
   virtual size_t write(uint8_t);
   void command(uint8_t);
+
+  // Framebuffer mode: print(), write(), setCursor(), clear() and home()
+  // only update a copy of the screen in RAM, and refresh() sends the cells
+  // that changed to the display one byte per call. Call refresh() from a
+  // timer interrupt every 50 us or more; Platino does it from its 1 ms
+  // tick. Cursor, blink, scrolling and right to left text don't mix with
+  // this mode. Returns false if there is not enough RAM for the buffer.
+  bool framebuffer(bool true_false=true);
+  void refresh(void) { if (_fb_any) refreshStep(); }
+  // Wait until the display shows everything written so far.
+  void flush(void);
   
   using Print::write;
 private:
   void send(uint8_t, uint8_t);
+  void transfer(uint8_t, uint8_t);
+  void refreshStep(void);
+  void hold(void);
   void write4bits(uint8_t);
   void write8bits(uint8_t);
   void pulseEnable();
+  void enable(uint8_t);
+  void waitReady(void);
 
   uint8_t _rs_pin; // LOW: command.  HIGH: character.
   uint8_t _rw_pin; // LOW: write to LCD.  HIGH: read from LCD.
   uint8_t _enable_pin; // activated by a HIGH pulse.
   uint8_t _data_pins[8];
 
+  volatile uint8_t *_rs_port;
+  uint8_t _rs_mask;
+  volatile uint8_t *_enable_port;
+  uint8_t _enable_mask;
+  volatile uint8_t *_data_port; // 0 unless D4..D7 share a port, in order.
+  volatile uint8_t *_data_ddr;
+  volatile uint8_t *_data_pin;
+  uint8_t _data_shift; // Bit of D4 in that port.
+
   uint8_t _displayfunction;
   uint8_t _displaycontrol;
   uint8_t _displaymode;
 
-  uint8_t _initialized;
+  uint8_t _initialized; // Set when the busy flag can be polled.
 
   uint8_t _numlines;
+  uint8_t _cols;
   uint8_t _row_offsets[4];
+
+  uint8_t *_fb; // Screen contents, _cols*_numlines bytes, 0 if not in use.
+  uint8_t *_fb_dirty; // One bit per cell that still has to be sent.
+  volatile uint8_t _fb_any; // Set when at least one bit is.
+  volatile uint8_t _fb_hold; // The sketch is talking to the display itself.
+  uint8_t _fb_pos; // Where write() puts the next character.
+  uint8_t _fb_scan; // Where refresh() starts looking.
+  uint8_t _fb_addr; // The display's DDRAM address, 0xFF when unknown.
 };
 
 #endif
@@ -0,0 +1,85 @@
+/*
+  PinGroup.h - Write or read up to eight pins at the same time
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef PinGroup_h
+#define PinGroup_h
+
+#ifdef __cplusplus
+
+#include <inttypes.h>
+
+// A PinGroup drives a parallel bus: bit i of the value goes to the i-th pin
+// of the list it was made from, wherever the pins are. Arduino.h doesn't
+// include this header, sketches do.
+//
+//   #include <PinGroup.h>
+//
+//   const uint8_t pins[] = { 2, 3, 4, 5, 10, 11, 12, 13 };
+//   PinGroup data(pins, sizeof(pins));
+//   data.output();
+//   data.write(0xA5);
+//
+// begin() works out which ports the pins are on and fills, per port, two
+// 16 entry scatter tables (value nibble to port bits) and two gather tables
+// (port nibble to value bits). write() then costs two lookups per port
+// before a single cli section that does one read-modify-write per port, so
+// all the pins on one port change in the same cycle and the ports follow
+// each other a few cycles apart. read() samples every port in one cli
+// section and gathers the bits afterwards. Each port takes 71 bytes of heap.
+#define PIN_GROUP_MAX_PINS 8
+
+struct PinGroupPort {
+  volatile uint8_t *out;
+  volatile uint8_t *in;
+  volatile uint8_t *ddr;
+  uint8_t mask;
+  uint8_t scatter[2][16];
+  uint8_t gather[2][16];
+};
+
+class PinGroup
+{
+public:
+  PinGroup() : _ports(0), _nports(0), _count(0) {}
+  PinGroup(const uint8_t *pins, uint8_t count) : _ports(0), _nports(0), _count(0) { begin(pins, count); }
+  ~PinGroup() { end(); }
+
+  // Returns false for more than PIN_GROUP_MAX_PINS pins, a pin that does
+  // not exist or when there is not enough memory, and the group is empty.
+  bool begin(const uint8_t *pins, uint8_t count);
+  void end(void);
+  uint8_t size(void) { return _count; }
+
+  void output(void);
+  void input(void);
+  void write(uint8_t value);
+  uint8_t read(void);
+
+private:
+  PinGroup(const PinGroup&);
+  PinGroup& operator=(const PinGroup&);
+
+  PinGroupPort *_ports;
+  uint8_t _nports;
+  uint8_t _count;
+  uint8_t _pins[PIN_GROUP_MAX_PINS];
+};
+
+#endif
+
+#endif
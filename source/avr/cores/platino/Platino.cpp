@@ -123,6 +123,24 @@ void CPlatino::init(uint8_t jp1, uint8_t jp3, uint8_t jp4, uint8_t jp5, uint8_t
   _has_led_red = false;
   _has_led_green = false;
   _has_led_blue = false;
+
+  _pushbutton_pinb = 0;
+  _pushbutton_pinc = 0;
+  _pushbutton_level = 0;
+  _pushbutton_count0 = 0;
+  _pushbutton_count1 = 0;
+
+#if PLATINO_EVENT_QUEUE_SIZE
+  _has_events = false;
+  _event_head = 0;
+  _event_tail = 0;
+  _event_dropped = 0;
+  _event_dropped_read = 0;
+  _pushbutton_down = 0;
+  _pushbutton_long = 0;
+  _knob_reported[0] = 0;
+  _knob_reported[1] = 0;
+#endif
 }
 
 
@@ -235,9 +253,23 @@ boolean CPlatino::hasLedRgb(boolean true_false)
 
 void CPlatino::led(uint8_t color, uint8_t value)
 {
-  if (color==LED_RED && _has_led_red==true) digitalWrite(LED_RED_PIN,value); // red  
-  else if (color==LED_GREEN && _has_led_green==true) digitalWrite(LED_GREEN_PIN,value); // green
-  else if (color==LED_BLUE && _has_led_blue==true) digitalWrite(LED_BLUE_PIN,value); // blue 
+  uint8_t pin = ledPin(color);
+  if (pin!=PIN_NOT_SET)
+  {
+    // Take the pin back from ledDim(), without linking it in if unused.
+    if (bamRelease) bamRelease(pin);
+    digitalWrite(pin,value);
+  }
+}
+
+
+// The pin of an LED that hasLedColor() set up, PIN_NOT_SET otherwise.
+uint8_t CPlatino::ledPin(uint8_t color)
+{
+  if (color==LED_RED && _has_led_red==true) return LED_RED_PIN; // red
+  else if (color==LED_GREEN && _has_led_green==true) return LED_GREEN_PIN; // green
+  else if (color==LED_BLUE && _has_led_blue==true) return LED_BLUE_PIN; // blue
+  return PIN_NOT_SET;
 }
 
 
@@ -264,6 +296,24 @@ void CPlatino::beep(unsigned int frequency, unsigned long duration)
 }
 
 
+void CPlatino::melody(const ToneNote *notes, uint8_t repeat, boolean queue)
+{
+  if (_has_buzzer==true)
+  {
+    playMelody(BUZZER,notes,repeat,queue);
+  }
+}
+
+
+void CPlatino::melodyStop(void)
+{
+  if (_has_buzzer==true)
+  {
+    stopMelody();
+  }
+}
+
+
 boolean CPlatino::hasPushbutton(uint8_t nr, boolean true_false)
 { 
   if (nr==1)
@@ -275,6 +325,7 @@ boolean CPlatino::hasPushbutton(uint8_t nr, boolean true_false)
       pushbutton1.init(S1);
       _has_pushbutton1 = true;
     }
+    pushbuttonAttach(1,_has_pushbutton1==true?S1:PIN_NOT_SET);
     return _has_pushbutton1;
   }
   else if (nr==2)
@@ -286,6 +337,7 @@ boolean CPlatino::hasPushbutton(uint8_t nr, boolean true_false)
       pushbutton2.init(S2);
       _has_pushbutton2 = true;
     }
+    pushbuttonAttach(2,_has_pushbutton2==true?S2:PIN_NOT_SET);
     return _has_pushbutton2;
   }
   else if (nr==3)
@@ -297,6 +349,7 @@ boolean CPlatino::hasPushbutton(uint8_t nr, boolean true_false)
       pushbutton3.init(S3);
       _has_pushbutton3 = true;
     }
+    pushbuttonAttach(3,_has_pushbutton3==true?S3:PIN_NOT_SET);
     return _has_pushbutton3;
   }
   else if (nr==4)
@@ -308,12 +361,36 @@ boolean CPlatino::hasPushbutton(uint8_t nr, boolean true_false)
       pushbutton4.init(S4);
       _has_pushbutton4 = true;
     }
+    pushbuttonAttach(4,_has_pushbutton4==true?S4:PIN_NOT_SET);
     return _has_pushbutton4;
   }
   return false;
 }
 
 
+// Add the pin of pushbutton nr to the port masks that tick() debounces,
+// or remove it when pin is PIN_NOT_SET. The debounced level starts out
+// as pressed, so a released button reports PUSHBUTTON_UP after four ticks
+// just like Pushbutton::debounce() does.
+void CPlatino::pushbuttonAttach(uint8_t nr, uint8_t pin)
+{
+  uint8_t mask = _BV(nr-1);
+  uint8_t oldSREG = SREG;
+  cli();
+  _pushbutton_pinb &= ~mask;
+  _pushbutton_pinc &= ~mask;
+  if (pin!=PIN_NOT_SET)
+  {
+    if (portInputRegister(digitalPinToPort(pin))==&PINB) _pushbutton_pinb |= mask;
+    else _pushbutton_pinc |= mask;
+  }
+  _pushbutton_level &= ~mask;
+  _pushbutton_count0 &= ~mask;
+  _pushbutton_count1 &= ~mask;
+  SREG = oldSREG;
+}
+
+
 uint8_t CPlatino::pushbuttonRead(uint8_t nr, boolean clear)
 {
        if (nr==1 && _has_pushbutton1==true) return pushbutton1.read(clear);
@@ -346,6 +423,9 @@ boolean CPlatino::hasKnob(uint8_t nr, boolean true_false)
       if (_has_pushbutton2==false) hasPushbutton(2,true);
       knob1.init();
       _has_knob1 = _has_pushbutton1 && _has_pushbutton2;
+#if defined(PLATINO_KNOB_PCINT)
+      if (_has_knob1==true) knobAttach(knob1,0,S1,S2);
+#endif
       return _has_knob1;
     }
   }
@@ -360,6 +440,9 @@ boolean CPlatino::hasKnob(uint8_t nr, boolean true_false)
       if (_has_pushbutton4==false) hasPushbutton(4,true);
       knob2.init();
       _has_knob2 = _has_pushbutton3 && _has_pushbutton4;
+#if defined(PLATINO_KNOB_PCINT)
+      if (_has_knob2==true) knobAttach(knob2,2,S3,S4);
+#endif
       return _has_knob2;
     }
   }
@@ -385,30 +468,155 @@ int16_t CPlatino::knobRead(uint8_t nr)
 
 void CPlatino::knobWrite(uint8_t nr, int16_t value)
 {
+#if PLATINO_EVENT_QUEUE_SIZE
+  // Keep tick() from reporting this as a knob movement.
+  uint8_t oldSREG = SREG;
+  cli();
+  if (nr==1 || nr==2) _knob_reported[nr-1] = value;
+  SREG = oldSREG;
+#endif
   if (nr==1 && _has_knob1==true) knob1.write(value);
   else if (nr==2 && _has_knob2==true) knob2.write(value);
 }
 
 
-void CPlatino::tick(void)
+void CPlatino::knobAcceleration(uint8_t nr, uint8_t window, uint8_t boost)
+{
+  if (nr==1) knob1.acceleration(window,boost);
+  else if (nr==2) knob2.acceleration(window,boost);
+}
+
+
+#if PLATINO_EVENT_QUEUE_SIZE
+boolean CPlatino::hasEvents(boolean true_false)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  _has_events = true_false;
+  _event_tail = _event_head;
+  _pushbutton_down = 0;
+  _pushbutton_long = 0;
+  _knob_reported[0] = knob1.value();
+  _knob_reported[1] = knob2.value();
+  SREG = oldSREG;
+  return _has_events;
+}
+
+
+boolean CPlatino::eventRead(PlatinoEvent &event)
+{
+  uint8_t tail = _event_tail;
+  if (tail==_event_head) return false;
+  event.type = _events[tail].type;
+  event.nr = _events[tail].nr;
+  event.delta = _events[tail].delta;
+  event.time = _events[tail].time;
+  // Hand the slot back to tick() only after it has been copied.
+  _event_tail = (tail+1) & (PLATINO_EVENT_QUEUE_SIZE-1);
+  return true;
+}
+
+
+uint8_t CPlatino::eventOverflow(boolean clear)
+{
+  // tick() only ever increments _event_dropped, so counting what was
+  // read here avoids a read-modify-write race with the ISR.
+  uint8_t dropped = _event_dropped;
+  uint8_t result = dropped - _event_dropped_read;
+  if (clear==true) _event_dropped_read = dropped;
+  return result;
+}
+
+
+void CPlatino::eventPush(uint8_t type, uint8_t nr, int16_t delta, uint16_t time)
 {
-  if (_has_pushbutton1==true)
+  uint8_t head = _event_head;
+  uint8_t next = (head+1) & (PLATINO_EVENT_QUEUE_SIZE-1);
+  if (next==_event_tail)
   {
-    pushbutton1.debounce();
+    _event_dropped += 1;
+    return;
   }
-  if (_has_pushbutton2==true)
+  _events[head].type = type;
+  _events[head].nr = nr;
+  _events[head].delta = delta;
+  _events[head].time = time;
+  _event_head = next;
+}
+
+
+// Called from tick() with the pushbuttons whose debounced level just
+// flipped. Most ticks have nothing to report and return before millis().
+void CPlatino::eventTick(uint8_t toggle)
+{
+  int16_t knob_delta1 = _has_knob1==true ? knob1.value()-_knob_reported[0] : 0;
+  int16_t knob_delta2 = _has_knob2==true ? knob2.value()-_knob_reported[1] : 0;
+  uint8_t holding = _pushbutton_down & ~_pushbutton_long;
+  if (toggle==0 && holding==0 && knob_delta1==0 && knob_delta2==0) return;
+
+  uint16_t now = millis();
+  for (uint8_t i=0; i<4; i++)
   {
-    pushbutton2.debounce();
+    uint8_t mask = _BV(i);
+    if (toggle & mask)
+    {
+      if ((_pushbutton_level & mask)==0)
+      {
+        _pushbutton_down |= mask;
+        _pushbutton_long &= ~mask;
+        _pushbutton_down_time[i] = now;
+        eventPush(PLATINO_EVENT_DOWN,i+1,0,now);
+      }
+      else if (_pushbutton_down & mask)
+      {
+        // The first release after attaching a button is not reported.
+        _pushbutton_down &= ~mask;
+        eventPush(PLATINO_EVENT_UP,i+1,0,now);
+      }
+    }
+    else if ((holding & mask) && (uint16_t)(now-_pushbutton_down_time[i])>=PLATINO_LONG_PRESS)
+    {
+      _pushbutton_long |= mask;
+      eventPush(PLATINO_EVENT_LONG,i+1,0,now);
+    }
   }
-  if (_has_pushbutton3==true)
+
+  if (knob_delta1!=0)
   {
-    pushbutton3.debounce();
+    _knob_reported[0] += knob_delta1;
+    eventPush(PLATINO_EVENT_KNOB,1,knob_delta1,now);
   }
-  if (_has_pushbutton4==true)
+  if (knob_delta2!=0)
   {
-    pushbutton4.debounce();
+    _knob_reported[1] += knob_delta2;
+    eventPush(PLATINO_EVENT_KNOB,2,knob_delta2,now);
   }
+}
+#endif
 
+
+void CPlatino::tick(void)
+{
+  // Debounce all pushbuttons at once from a single read of PINB and PINC.
+  // Each button has a two bit vertical counter (bit n-1 of count0 and
+  // count1) that runs while the pin differs from the debounced level and
+  // flips the level when it wraps, i.e. after four equal samples in a row.
+  uint8_t sample = pushbuttonPins();
+  uint8_t delta = sample ^ _pushbutton_level;
+  _pushbutton_count1 = (_pushbutton_count1 ^ _pushbutton_count0) & delta;
+  _pushbutton_count0 = ~_pushbutton_count0 & delta;
+  uint8_t toggle = delta & ~(_pushbutton_count0 | _pushbutton_count1);
+  if (toggle!=0)
+  {
+    uint8_t level = _pushbutton_level ^ toggle;
+    _pushbutton_level = level;
+    if (toggle & 0x01) pushbutton1.update(level & 0x01);
+    if (toggle & 0x02) pushbutton2.update(level & 0x02);
+    if (toggle & 0x04) pushbutton3.update(level & 0x04);
+    if (toggle & 0x08) pushbutton4.update(level & 0x08);
+  }
+
+#if !defined(PLATINO_KNOB_PCINT)
   if (_has_knob1==true)
   {
     uint8_t a = pushbutton1.read(false);
@@ -428,9 +636,67 @@ void CPlatino::tick(void)
       knob2.tick(a,b);
     }
   }
+#endif
+
+#if PLATINO_EVENT_QUEUE_SIZE
+  if (_has_events==true) eventTick(toggle);
+#endif
+
+  // Sends a byte to the display if it is in framebuffer mode and has
+  // something new to show.
+  if (_has_display==true) display.refresh();
+}
+
+
+#if defined(PLATINO_KNOB_PCINT)
+
+#if !defined(PCICR)
+#error "PLATINO_KNOB_PCINT needs pin change interrupts"
+#elif defined(ATMEGA_X4)
+#define KNOB_PORTB_vect  PCINT1_vect
+#define KNOB_PORTC_vect  PCINT2_vect
+#else
+#define KNOB_PORTB_vect  PCINT0_vect
+#define KNOB_PORTC_vect  PCINT1_vect
+#endif
+
+
+// Start decoding a knob from the pin change interrupts of its pins. The
+// encoder starts from the current pin state so the first edge counts.
+void CPlatino::knobAttach(RotaryEncoder &knob, uint8_t shift, uint8_t pin_a, uint8_t pin_b)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  knob.init((pushbuttonPins()>>shift) & 0x03);
+  *digitalPinToPCMSK(pin_a) |= _BV(digitalPinToPCMSKbit(pin_a));
+  *digitalPinToPCMSK(pin_b) |= _BV(digitalPinToPCMSKbit(pin_b));
+  *digitalPinToPCICR(pin_a) |= _BV(digitalPinToPCICRbit(pin_a));
+  *digitalPinToPCICR(pin_b) |= _BV(digitalPinToPCICRbit(pin_b));
+  SREG = oldSREG;
+}
+
+
+// One snapshot of both ports feeds both knobs, each one looks up the
+// direction of the transition in a table so every edge costs the same.
+void CPlatino::knobEdge(void)
+{
+  uint8_t pins = pushbuttonPins();
+  if (_has_knob1==true) knob1.edge(pins & 0x03);
+  if (_has_knob2==true) knob2.edge((pins>>2) & 0x03);
 }
 
 
+ISR(KNOB_PORTB_vect)
+{
+  Platino.knobEdge();
+}
+
+
+ISR(KNOB_PORTC_vect, ISR_ALIASOF(KNOB_PORTB_vect));
+
+#endif
+
+
 // The global Platino object.
 CPlatino Platino;
 
@@ -53,12 +53,25 @@ Platino.begin('B','C','B','B','B','B','B','D','D');
 
 Note that:
  - if JP3=='C' then PC5 is shared between LCD backlight and RGB LED 3.
+
+Rotary encoders
+---------------
+By default the knobs are decoded in the 1 ms timer tick from the debounced
+pushbutton states. Build with PLATINO_KNOB_PCINT defined to decode them
+from pin change interrupts on every edge instead, for fast spins and for
+encoders that step at a few kHz. This takes the pin change vectors of
+ports B and C, so it cannot be combined with other users of those, like
+SoftwareSerial on these ports.
 */
 
 
 #include "LiquidCrystal.h"
 #include "RotaryEncoder.h"
 #include "Pushbutton.h"
+#include "Bam.h"
+
+
+struct ToneNote;
 
 
 // LCD
@@ -74,6 +87,34 @@ Note that:
 #define LCD_D7  (7) /* PD7 ** D7 */
 
 
+// Input events, see eventRead(). Define PLATINO_EVENT_QUEUE_SIZE as 0 in
+// the build flags to leave the queue out, otherwise it must be a power
+// of two.
+#if !defined(PLATINO_EVENT_QUEUE_SIZE)
+#define PLATINO_EVENT_QUEUE_SIZE  (8)
+#endif
+#if (PLATINO_EVENT_QUEUE_SIZE & (PLATINO_EVENT_QUEUE_SIZE-1)) || PLATINO_EVENT_QUEUE_SIZE>128
+#error "PLATINO_EVENT_QUEUE_SIZE must be a power of two, at most 128"
+#endif
+// Time a pushbutton must be held to report PLATINO_EVENT_LONG, in ms.
+#if !defined(PLATINO_LONG_PRESS)
+#define PLATINO_LONG_PRESS  (1000)
+#endif
+
+#define PLATINO_EVENT_DOWN  (1)
+#define PLATINO_EVENT_UP  (2)
+#define PLATINO_EVENT_LONG  (3)
+#define PLATINO_EVENT_KNOB  (4)
+
+struct PlatinoEvent
+{
+  uint8_t type; // PLATINO_EVENT_xxx
+  uint8_t nr; // Pushbutton or knob number.
+  int16_t delta; // Knob movement, 0 for pushbuttons.
+  uint16_t time; // millis() when it happened, lower 16 bits.
+};
+
+
 #define LED_RED  (1)
 #define LED_GREEN  (2)
 #define LED_BLUE  (3)
@@ -104,6 +145,28 @@ class CPlatino
     boolean _has_led_green;
     boolean _has_led_blue;
 
+    // Port debouncer, bit n-1 is pushbutton n (PB0..3 or PC0..3).
+    uint8_t _pushbutton_pinb;
+    uint8_t _pushbutton_pinc;
+    uint8_t _pushbutton_level;
+    uint8_t _pushbutton_count0;
+    uint8_t _pushbutton_count1;
+
+#if PLATINO_EVENT_QUEUE_SIZE
+    // Single producer (tick) single consumer (eventRead) ring, the ISR
+    // only moves _event_head and the sketch only moves _event_tail.
+    boolean _has_events;
+    volatile PlatinoEvent _events[PLATINO_EVENT_QUEUE_SIZE];
+    volatile uint8_t _event_head;
+    volatile uint8_t _event_tail;
+    volatile uint8_t _event_dropped;
+    uint8_t _event_dropped_read;
+    uint8_t _pushbutton_down;
+    uint8_t _pushbutton_long;
+    uint16_t _pushbutton_down_time[4];
+    int16_t _knob_reported[2];
+#endif
+
     Pushbutton pushbutton1;
     Pushbutton pushbutton2;
     Pushbutton pushbutton3;
@@ -112,6 +175,15 @@ class CPlatino
     RotaryEncoder knob2;
     
     void showPin(uint8_t pin, uint8_t space=1);
+    void pushbuttonAttach(uint8_t nr, uint8_t pin);
+    uint8_t pushbuttonPins(void) { return (PINB & _pushbutton_pinb) | (PINC & _pushbutton_pinc); }
+#if PLATINO_EVENT_QUEUE_SIZE
+    void eventPush(uint8_t type, uint8_t nr, int16_t delta, uint16_t time);
+    void eventTick(uint8_t toggle);
+#endif
+#if defined(PLATINO_KNOB_PCINT)
+    void knobAttach(RotaryEncoder &knob, uint8_t shift, uint8_t pin_a, uint8_t pin_b);
+#endif
 
   public:
     CPlatino();
@@ -133,6 +205,9 @@ class CPlatino
     boolean hasBuzzer(boolean true_false=true);
     boolean hasPushbutton(uint8_t nr, boolean true_false=true);
     boolean hasKnob(uint8_t nr, boolean true_false=true);
+#if PLATINO_EVENT_QUEUE_SIZE
+    boolean hasEvents(boolean true_false=true);
+#endif
 
     // Step 3. Use the peripherals.
     uint8_t pushbuttonRead(uint8_t nr, boolean clear=true);
@@ -141,6 +216,15 @@ class CPlatino
     boolean knobChanged(uint8_t nr);
     int16_t knobRead(uint8_t nr);
     void knobWrite(uint8_t nr, int16_t value);
+    void knobAcceleration(uint8_t nr, uint8_t window, uint8_t boost);
+#if PLATINO_EVENT_QUEUE_SIZE
+    // Input events, in the order they happened. Unlike pushbuttonRead() a
+    // press and release between two calls are both seen. Returns false
+    // when the queue is empty.
+    boolean eventRead(PlatinoEvent &event);
+    // Number of events lost because the queue was full (modulo 256).
+    uint8_t eventOverflow(boolean clear=true);
+#endif
     // LCD.
     LiquidCrystal display;
     void backlight(uint8_t value);
@@ -148,11 +232,26 @@ class CPlatino
     void led(uint8_t color, uint8_t value);
     void led(uint8_t value) { led(LED_GREEN,value); }
     void ledRgb(uint8_t red, uint8_t green, uint8_t blue) { led(LED_RED,red); led(LED_GREEN,green); led(LED_BLUE,blue); }
+#if defined(HAVE_BAM)
+    // Dimmable LEDs on any jumper setting, brightness 0..255 is gamma
+    // corrected. See Bam.h for what this does to timer 1. led() gives the
+    // pin back.
+    void ledDim(uint8_t color, uint8_t brightness) { uint8_t pin = ledPin(color); if (pin!=PIN_NOT_SET) bamWrite(pin,brightness); }
+    void ledRgbDim(uint8_t red, uint8_t green, uint8_t blue) { ledDim(LED_RED,red); ledDim(LED_GREEN,green); ledDim(LED_BLUE,blue); }
+#endif
+    uint8_t ledPin(uint8_t color);
     // Buzzer
     void beep(unsigned int frequency, unsigned long duration);
+    // Plays a table of notes in PROGMEM in the background, see playMelody().
+    void melody(const ToneNote *notes, uint8_t repeat=1, boolean queue=false);
+    void melodyStop(void);
     
     // This is called from the Timer0 ISR.
     void tick(void);
+#if defined(PLATINO_KNOB_PCINT)
+    // This is called from the pin change ISRs.
+    void knobEdge(void);
+#endif
 };
 
 
@@ -0,0 +1,101 @@
+/*
+  Profile.cpp - Scoped cycle counters to find out where the time goes
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "Print.h"
+#include "Profile.h"
+
+#if defined(CORE_PROFILING)
+
+struct profile_entry {
+  uint32_t count;
+  uint32_t total;
+  uint32_t min;
+  uint32_t max;
+};
+
+static profile_entry profile_table[PROFILE_SLOTS];
+
+// Called at the end of every PROFILE_SCOPE, from interrupt handlers too.
+void profile_end(struct profile_mark *mark)
+{
+  uint32_t cycles = cycleCount() - mark->start;
+
+  if (mark->id >= PROFILE_SLOTS)
+    return;
+  profile_entry *e = &profile_table[mark->id];
+
+  uint8_t oldSREG = SREG;
+  cli();
+  if (e->count == 0 || cycles < e->min)
+    e->min = cycles;
+  if (cycles > e->max)
+    e->max = cycles;
+  e->total += cycles;
+  e->count++;
+  SREG = oldSREG;
+}
+
+void profileReset(void)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  memset(profile_table, 0, sizeof(profile_table));
+  SREG = oldSREG;
+}
+
+static void profile_write32(Print &out, uint32_t v)
+{
+  out.write((const uint8_t *)&v, sizeof(v));
+}
+
+void profileDump(Print &out, uint8_t format)
+{
+  if (format == PROFILE_BINARY) {
+    out.write('P');
+    out.write((uint8_t)PROFILE_SLOTS);
+  }
+  for (uint8_t id = 0; id < PROFILE_SLOTS; id++) {
+    // copy the entry so that it is consistent, printing takes too long to
+    // do with interrupts disabled
+    uint8_t oldSREG = SREG;
+    cli();
+    profile_entry e = profile_table[id];
+    SREG = oldSREG;
+
+    if (format == PROFILE_BINARY) {
+      out.write(id);
+      profile_write32(out, e.count);
+      profile_write32(out, e.total);
+      profile_write32(out, e.min);
+      profile_write32(out, e.max);
+    } else if (e.count) {
+      out.print(id);
+      out.print(' ');
+      out.print(e.count);
+      out.print(' ');
+      out.print(e.min);
+      out.print(' ');
+      out.print(e.max);
+      out.print(' ');
+      out.println(e.total / e.count);
+    }
+  }
+}
+
+#endif // CORE_PROFILING
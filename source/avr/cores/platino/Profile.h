@@ -0,0 +1,89 @@
+/*
+  Profile.h - Scoped cycle counters to find out where the time goes
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef Profile_h
+#define Profile_h
+
+#include <inttypes.h>
+
+// Define CORE_PROFILING in the build flags, together with
+// CYCLE_COUNTER_TIMER (see wiring.c), to have PROFILE_SCOPE(id) record the
+// number of CPU cycles from where it is to the end of the enclosing block
+// in slot id of a table: count, total, minimum and maximum. The core uses
+// the first slots for its own hot paths, sketches and libraries start at
+// PROFILE_ID_USER. The figures include the 30 or so cycles it takes to
+// read the counter. Without CORE_PROFILING, PROFILE_SCOPE(id) is empty.
+#if defined(CORE_PROFILING)
+
+#if !defined(CYCLE_COUNTER_TIMER)
+#error "CORE_PROFILING needs CYCLE_COUNTER_TIMER"
+#endif
+
+#if !defined(PROFILE_SLOTS)
+#define PROFILE_SLOTS 12
+#endif
+
+#define PROFILE_ID_TIMER0_OVF 0
+#define PROFILE_ID_SERIAL_RX 1
+#define PROFILE_ID_SERIAL_UDRE 2
+#define PROFILE_ID_ANALOG_READ 3
+#define PROFILE_ID_DIGITAL_WRITE 4
+#define PROFILE_ID_USER 5
+
+// Formats for profileDump()
+#define PROFILE_TEXT 0
+#define PROFILE_BINARY 1
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+struct profile_mark {
+  uint8_t id;
+  unsigned long start;
+};
+
+unsigned long cycleCount(void);
+void profile_end(struct profile_mark *mark);
+void profileReset(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define PROFILE_CONCAT2(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(id) \
+  struct profile_mark PROFILE_CONCAT(_profile_mark_, __LINE__) \
+    __attribute__((cleanup(profile_end))) = { (id), cycleCount() }
+
+#ifdef __cplusplus
+class Print;
+// Text is one line per slot that has been used: id, count, min, max and
+// average cycles. Binary is 'P', the number of slots and per slot the id
+// and count, total, min and max as 32 bit little endian numbers.
+void profileDump(Print &out, uint8_t format = PROFILE_TEXT);
+#endif
+
+#else
+
+#define PROFILE_SCOPE(id)
+
+#endif // CORE_PROFILING
+
+#endif
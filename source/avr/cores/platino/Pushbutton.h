@@ -54,6 +54,8 @@ class Pushbutton
     uint8_t debounce(void);
     uint8_t read(boolean clear=true);
     void clear(void) { _state = PUSHBUTTON_IDLE; }
+    // Report a new debounced level when debouncing is done elsewhere.
+    void update(uint8_t level) { _state = level ? PUSHBUTTON_UP : PUSHBUTTON_DOWN; }
     uint8_t readDebounced(void);
 };
 
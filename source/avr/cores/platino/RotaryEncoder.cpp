@@ -23,21 +23,72 @@
 
 */
 
+#include "Arduino.h"
 #include "RotaryEncoder.h"
 
 
 RotaryEncoder::RotaryEncoder(void)
 {
   init();
+  _accelWindow = 0;
+  _accelBoost = 0;
 }
 
 
-void RotaryEncoder::init(void)
+// Direction of a step indexed by (old state<<2)|new state, 0 for no change
+// or for an invalid transition where both A and B changed.
+static const int8_t quadrature[16] PROGMEM =
 {
-  _stateOld = 0;
+   0, -1,  1,  0,
+   1,  0,  0, -1,
+  -1,  0,  0,  1,
+   0,  1, -1,  0
+};
+
+
+void RotaryEncoder::init(uint8_t state)
+{
+  _stateOld = state;
   _stateSub = 0;
   _value = 0;
   _changed = false;
+  _lastDetent = 0;
+}
+
+
+int16_t RotaryEncoder::read(void)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  int16_t value = _value;
+  _changed = false;
+  SREG = oldSREG;
+  return value;
+}
+
+
+void RotaryEncoder::write(int16_t value)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  _value = value;
+  _changed = true;
+  SREG = oldSREG;
+}
+
+
+void RotaryEncoder::detent(int8_t inc)
+{
+  int16_t step = inc;
+  if (_accelWindow!=0)
+  {
+    uint16_t now = millis();
+    uint16_t dt = now - _lastDetent;
+    _lastDetent = now;
+    if (dt<_accelWindow) step *= 1 + (uint16_t)_accelBoost*(_accelWindow-dt)/_accelWindow;
+  }
+  _value += step;
+  _changed = true;
 }
 
 
@@ -61,12 +112,28 @@ uint8_t RotaryEncoder::tick(uint8_t a, uint8_t b)
     _stateSub += inc;
     if (_stateSub<=-4 || _stateSub>=4)
     {
-      _value += inc;
+      detent(inc);
       _stateSub -= (inc<<2);
-      _changed = true;
       result = 1;
     }
   }
   
   return result;
 }
+
+
+void RotaryEncoder::edge(uint8_t state)
+{
+  int8_t inc = pgm_read_byte(&quadrature[(_stateOld<<2)|state]);
+  _stateOld = state;
+  if (inc!=0)
+  {
+    // Four steps per detent, a change of direction half way cancels out.
+    _stateSub += inc;
+    if (_stateSub<=-4 || _stateSub>=4)
+    {
+      detent(inc);
+      _stateSub = 0;
+    }
+  }
+}
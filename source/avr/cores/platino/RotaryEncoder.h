@@ -40,19 +40,37 @@ class RotaryEncoder
   private:
     uint8_t _stateOld;
     int8_t _stateSub;
-    int16_t _value;
-    int8_t _changed;
+    volatile int16_t _value;
+    volatile int8_t _changed;
+    uint8_t _accelWindow;
+    uint8_t _accelBoost;
+    uint16_t _lastDetent;
+
+    void detent(int8_t inc);
 
   public:
     RotaryEncoder(void);
-    void init(void);
+    // Starts over at value 0 from state = A + (B<<1). The acceleration
+    // settings are kept.
+    void init(uint8_t state=0);
 
     uint8_t changed(void) { return _changed; }
-    int16_t read(void) { _changed = false; return _value; }
-    void write(int16_t value) { /*cli();*/ _value = value; _changed = true; /*sei();*/ }
+    int16_t read(void);
+    // Value without clearing changed(), for use with interrupts off.
+    int16_t value(void) { return _value; }
+    void write(int16_t value);
+
+    // Optional acceleration: detents less than window ms apart move the
+    // value by up to 1+boost, the faster the spin the larger the step.
+    // A window of 0 (the default) turns it off.
+    void acceleration(uint8_t window, uint8_t boost) { _accelWindow = window; _accelBoost = boost; }
     
     // Call this function regularly, like every millisecond or so.
     uint8_t tick(uint8_t a, uint8_t b);
+
+    // Or call this one on every edge of A or B, f.ex. from a pin change
+    // interrupt, with state = A + (B<<1).
+    void edge(uint8_t state);
 };
 
 
@@ -247,6 +247,131 @@ static int8_t toneBegin(uint8_t _pin)
 
 
 
+#ifdef USE_TIMER2
+// Melody player, see playMelody(). Only a pointer into the note table in
+// flash is kept, nothing per note. The timer 2 interrupt moves on to the
+// next note when the toggle count of the current one runs out.
+static const ToneNote * volatile melody_note; // next note, 0 when idle
+static const ToneNote *melody_start;
+static uint8_t melody_repeat; // plays left, 0 is forever
+static const ToneNote * volatile melody_queued;
+static uint8_t melody_queued_repeat;
+static uint8_t melody_pin_mask;
+
+// Timer 2 prescaler choices as shifts, in TCCR2B clock select order.
+const uint8_t PROGMEM melody_prescale_shift_PGM[] = { 0, 3, 5, 6, 7, 8, 10 };
+
+// Sets timer 2 up for one note. This runs in the interrupt, so instead of
+// a division per prescaler like tone() it divides once and shifts.
+static void melody_timer2(unsigned int frequency, unsigned int duration)
+{
+  if (frequency == 0)
+  {
+    // a rest: let the timer count the time but leave the pin low
+    frequency = 500;
+    timer2_pin_mask = 0;
+    *timer2_pin_port &= ~melody_pin_mask;
+  }
+  else
+  {
+    timer2_pin_mask = melody_pin_mask;
+  }
+
+  uint32_t ticks = F_CPU / 2 / frequency;
+  uint8_t prescalarbits = 1;
+  while (prescalarbits < 7 && (ticks >> pgm_read_byte(melody_prescale_shift_PGM + prescalarbits - 1)) > 256)
+    prescalarbits++;
+
+  TCCR2B = (TCCR2B & 0b11111000) | prescalarbits;
+  OCR2A = (ticks >> pgm_read_byte(melody_prescale_shift_PGM + prescalarbits - 1)) - 1;
+  TCNT2 = 0;
+  timer2_toggle_count = (uint32_t)frequency * duration / 500;
+}
+
+// Starts the next note, going back to the start or on to the queued
+// melody at the end of the table. Returns false when there is nothing
+// left to play.
+static bool melody_next(void)
+{
+  // At most: end of table, back to the start, play.
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    const ToneNote *note = melody_note;
+    unsigned int duration = pgm_read_word(&note->duration);
+    if (duration != 0)
+    {
+      melody_note = note + 1;
+      melody_timer2(pgm_read_word(&note->frequency), duration);
+      return true;
+    }
+
+    if (melody_repeat != 1)
+    {
+      if (melody_repeat != 0)
+        melody_repeat--;
+      melody_note = melody_start;
+    }
+    else if (melody_queued != 0)
+    {
+      melody_note = melody_start = melody_queued;
+      melody_repeat = melody_queued_repeat;
+      melody_queued = 0;
+    }
+    else
+    {
+      break;
+    }
+  }
+  melody_note = 0;
+  return false;
+}
+
+void playMelody(uint8_t _pin, const ToneNote *melody, uint8_t repeat, bool queue)
+{
+  // an empty melody would keep melody_next() going round
+  if (pgm_read_word(&melody->duration) == 0)
+    return;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  if (queue && melody_note != 0)
+  {
+    melody_queued = melody;
+    melody_queued_repeat = repeat;
+    SREG = oldSREG;
+    return;
+  }
+  melody_note = 0;
+  melody_queued = 0;
+  SREG = oldSREG;
+
+  if (toneBegin(_pin) != 2)
+    return;
+  pinMode(_pin, OUTPUT);
+
+  cli();
+  melody_pin_mask = digitalPinToBitMask(_pin);
+  melody_start = melody;
+  melody_note = melody;
+  melody_repeat = repeat;
+  melody_next();
+  bitWrite(TIMSK2, OCIE2A, 1);
+  SREG = oldSREG;
+}
+
+void stopMelody(void)
+{
+  if (melody_note != 0)
+    noTone(tone_pins[0]);
+}
+
+bool melodyPlaying(void)
+{
+  return melody_note != 0;
+}
+#endif
+
+
 // frequency (in hertz) and duration (in milliseconds).
 
 void tone(uint8_t _pin, unsigned int frequency, unsigned long duration)
@@ -258,6 +383,15 @@ void tone(uint8_t _pin, unsigned int frequency, unsigned long duration)
 
   _timer = toneBegin(_pin);
 
+#ifdef USE_TIMER2
+  // a tone cuts off a melody on the same timer
+  if (_timer == 2)
+  {
+    melody_note = 0;
+    melody_queued = 0;
+  }
+#endif
+
   if (_timer >= 0)
   {
     // Set the pinMode as OUTPUT
@@ -498,6 +632,14 @@ void noTone(uint8_t _pin)
     }
   }
   
+#ifdef USE_TIMER2
+  if (_timer == 2)
+  {
+    melody_note = 0;
+    melody_queued = 0;
+  }
+#endif
+
   disableTimer(_timer);
 
   digitalWrite(_pin, 0);
@@ -557,6 +699,10 @@ ISR(TIMER2_COMPA_vect)
   }
   else
   {
+    // carry on with the melody, if one is playing
+    if (melody_note != 0 && melody_next())
+      return;
+
     // need to call noTone() so that the tone_pins[] entry is reset, so the
     // timer gets initialized next time we call tone().
     // XXX: this assumes timer 2 is always the first one used.
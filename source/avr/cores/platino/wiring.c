@@ -23,6 +23,8 @@
 */
 
 #include "wiring_private.h"
+#include <avr/sleep.h>
+#include "CoreSoftTimer.h"
 void platino_tick(void);  // CPV
 
 // the prescaler is set so that timer0 ticks every 64 clock cycles, and the
@@ -42,11 +44,12 @@ volatile unsigned long timer0_overflow_count = 0;
 volatile unsigned long timer0_millis = 0;
 static unsigned char timer0_fract = 0;
 
-#if defined(__AVR_ATtiny24__) || defined(__AVR_ATtiny44__) || defined(__AVR_ATtiny84__)
-ISR(TIM0_OVF_vect)
-#else
-ISR(TIMER0_OVF_vect)
-#endif
+volatile unsigned long scheduler_deadline = 0;
+volatile uint8_t scheduler_armed = 0;
+volatile uint8_t scheduler_due = 0;
+volatile uint8_t softtimer_active = 0;
+
+static inline void timer0_overflow(void)
 {
 	// copy these to local variables so they can be stored in registers
 	// (volatile variables must be read from memory on every access)
@@ -63,6 +66,23 @@ ISR(TIMER0_OVF_vect)
 	timer0_fract = f;
 	timer0_millis = m;
 	timer0_overflow_count++;
+
+	// tell schedulerRun() that the earliest task deadline has come
+	if (scheduler_armed && (long)(m - scheduler_deadline) >= 0)
+		scheduler_due = 1;
+
+	if (softtimer_active)
+		softtimer_tick(m);
+}
+
+#if defined(__AVR_ATtiny24__) || defined(__AVR_ATtiny44__) || defined(__AVR_ATtiny84__)
+ISR(TIM0_OVF_vect)
+#else
+ISR(TIMER0_OVF_vect)
+#endif
+{
+	PROFILE_SCOPE(PROFILE_ID_TIMER0_OVF);
+	timer0_overflow();
 	
 	platino_tick();  // CPV
 }
@@ -70,18 +90,121 @@ ISR(TIMER0_OVF_vect)
 unsigned long millis()
 {
 	unsigned long m;
+
+	// timer0_millis is 4 bytes, so the overflow interrupt can update it
+	// in the middle of a read. Instead of disabling interrupts, read it
+	// until two reads in a row agree: the interrupt comes at most once a
+	// millisecond, so only one of them can be torn, and a torn read only
+	// equals a clean one when it holds that same value.
+	do {
+		m = timer0_millis;
+	} while (m != timer0_millis);
+
+	return m;
+}
+
+// Define CYCLE_COUNTER_TIMER as 1, 3 or 4 to turn that 16 bit timer into
+// a CPU cycle counter for cycleCount(): prescaler 1, overflow interrupt
+// counting the upper bits. The timer is then no longer available for
+// analogWrite(), tone() or Servo. On the R4 board timer 4 is the best
+// choice, its only PWM pin is TX. With MICROS_FROM_CYCLE_COUNTER defined
+// as well, micros() is derived from it, in steps of 1 us instead of 4 us.
+#if defined(CYCLE_COUNTER_TIMER)
+#if CYCLE_COUNTER_TIMER == 1
+#define CC_TCNT TCNT1
+#define CC_TCCRA TCCR1A
+#define CC_TCCRB TCCR1B
+#define CC_CS0 CS10
+#define CC_TOV TOV1
+#define CC_TOIE TOIE1
+#define CC_OVF_vect TIMER1_OVF_vect
+#if defined(TIMSK1)
+#define CC_TIMSK TIMSK1
+#define CC_TIFR TIFR1
+#else
+#define CC_TIMSK TIMSK
+#define CC_TIFR TIFR
+#endif
+#elif CYCLE_COUNTER_TIMER == 3 && defined(TCNT3)
+#define CC_TCNT TCNT3
+#define CC_TCCRA TCCR3A
+#define CC_TCCRB TCCR3B
+#define CC_CS0 CS30
+#define CC_TOV TOV3
+#define CC_TOIE TOIE3
+#define CC_OVF_vect TIMER3_OVF_vect
+#define CC_TIMSK TIMSK3
+#define CC_TIFR TIFR3
+#elif CYCLE_COUNTER_TIMER == 4 && defined(TCNT4) && !defined(TCCR4D)
+#define CC_TCNT TCNT4
+#define CC_TCCRA TCCR4A
+#define CC_TCCRB TCCR4B
+#define CC_CS0 CS40
+#define CC_TOV TOV4
+#define CC_TOIE TOIE4
+#define CC_OVF_vect TIMER4_OVF_vect
+#define CC_TIMSK TIMSK4
+#define CC_TIFR TIFR4
+#else
+#error CYCLE_COUNTER_TIMER must be a 16 bit timer of this chip: 1, 3 or 4
+#endif
+
+static volatile unsigned long cycle_overflow_count = 0;
+
+ISR(CC_OVF_vect)
+{
+	cycle_overflow_count++;
+}
+
+// About 30 cycles including call and return, interrupts are disabled for
+// 14 of them.
+unsigned long cycleCount(void)
+{
 	uint8_t oldSREG = SREG;
 
-	// disable interrupts while we read timer0_millis or we might get an
-	// inconsistent value (e.g. in the middle of a write to timer0_millis)
 	cli();
-	m = timer0_millis;
+	uint16_t t = CC_TCNT;
+	uint16_t h = (uint16_t)cycle_overflow_count;
+	// an overflow that is pending has happened before t was read, unless
+	// t is from after the wrap already
+	if ((CC_TIFR & _BV(CC_TOV)) && t < 0x8000)
+		h++;
 	SREG = oldSREG;
 
-	return m;
+	return ((unsigned long)h << 16) | t;
 }
+#endif
 
 unsigned long micros() {
+#if defined(CYCLE_COUNTER_TIMER) && defined(MICROS_FROM_CYCLE_COUNTER)
+#if F_CPU == 16000000L
+#define CC_US_SHIFT 4
+#elif F_CPU == 8000000L
+#define CC_US_SHIFT 3
+#elif F_CPU == 4000000L
+#define CC_US_SHIFT 2
+#elif F_CPU == 2000000L
+#define CC_US_SHIFT 1
+#elif F_CPU == 1000000L
+#define CC_US_SHIFT 0
+#else
+#error MICROS_FROM_CYCLE_COUNTER needs a power of two clock in MHz
+#endif
+	// same as cycleCount(), with all 32 bits of the overflow count so
+	// that micros() still takes 71 minutes to wrap
+	unsigned long m;
+	uint8_t oldSREG = SREG;
+	uint16_t t;
+
+	cli();
+	t = CC_TCNT;
+	m = cycle_overflow_count;
+	if ((CC_TIFR & _BV(CC_TOV)) && t < 0x8000)
+		m++;
+	SREG = oldSREG;
+
+	return (m << (16 - CC_US_SHIFT)) | (t >> CC_US_SHIFT);
+#else
 	unsigned long m;
 	uint8_t oldSREG = SREG, t;
 	
@@ -106,8 +229,96 @@ unsigned long micros() {
 	SREG = oldSREG;
 	
 	return ((m << 8) + t) * (64 / clockCyclesPerMicrosecond());
+#endif
+}
+
+// Sleeps in IDLE mode until the next interrupt, unless that could be the
+// timer 0 overflow and it comes more than us microseconds from now. Any
+// interrupt wakes the CPU, but only the timer 0 overflow is sure to come.
+static void idle(unsigned long us)
+{
+	uint8_t oldSREG = SREG;
+
+	// sleeping with interrupts disabled would be forever
+	if (!(oldSREG & _BV(SREG_I)))
+		return;
+
+	// check and sleep with interrupts disabled, so that the overflow can't
+	// slip in between: sei() lets one more instruction execute before any
+	// pending interrupt, and an interrupt during sleep_cpu() wakes it up.
+	cli();
+	if (clockCyclesToMicroseconds(64UL * (256 - TCNT0)) <= us) {
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	SREG = oldSREG;
 }
 
+#if defined(TIMER2_32KHZ_CRYSTAL) && defined(ASSR) && defined(AS2)
+// With a 32768 Hz watch crystal on the TOSC pins, sleepUntil() sleeps in
+// power-save mode, where timer 0 stops and timer 2 keeps the time. Timer 2
+// then belongs to sleepUntil(): no tone() or PWM on its pins.
+
+// Time slept that doesn't make up a whole timer 0 overflow yet, in 1/16 us
+static unsigned long powersave_rest = 0;
+
+EMPTY_INTERRUPT(TIMER2_COMPB_vect);
+
+static void powersave(unsigned long ms)
+{
+	// timer 2 is prescaled by 32, so it ticks 1024 times per second
+	if (ms > 240)
+		ms = 240;
+	uint8_t ticks = ms * 1024 / 1000;
+	if (ticks < 2)
+		return;
+
+	if (!(ASSR & _BV(AS2))) {
+		TIMSK2 = 0;
+		ASSR = _BV(AS2);
+		TCCR2A = 0;
+		TCCR2B = _BV(CS21) | _BV(CS20);
+		while (ASSR & (_BV(TCR2AUB) | _BV(TCR2BUB)))
+			;
+	}
+
+	uint8_t oldSREG = SREG;
+	cli();
+	uint8_t start = TCNT2;
+	OCR2B = start + ticks;
+	while (ASSR & _BV(OCR2BUB))
+		;
+	TIFR2 = _BV(OCF2B);
+	TIMSK2 = _BV(OCIE2B);
+	set_sleep_mode(SLEEP_MODE_PWR_SAVE);
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+	cli();
+	TIMSK2 = 0;
+
+	// TCNT2 reads wrong until one crystal cycle after waking up, writing
+	// OCR2B and waiting for the write to complete takes care of that.
+	OCR2B = 0;
+	while (ASSR & _BV(OCR2BUB))
+		;
+	uint8_t slept = TCNT2 - start;
+
+	// Timer 0 stood still meanwhile, make up for its missed overflows so
+	// that millis() and micros() carry on as if it had run.
+	powersave_rest += slept * 15625UL; // 1000000 / 1024 us = 15625 / 16 us
+	while (powersave_rest >= 16UL * MICROSECONDS_PER_TIMER0_OVERFLOW) {
+		powersave_rest -= 16UL * MICROSECONDS_PER_TIMER0_OVERFLOW;
+		timer0_overflow();
+	}
+	SREG = oldSREG;
+}
+#endif
+
 void delay(unsigned long ms)
 {
 	uint32_t start = micros();
@@ -118,6 +329,33 @@ void delay(unsigned long ms)
 			ms--;
 			start += 1000;
 		}
+		uint32_t elapsed = micros() - start;
+		if (ms > 0 && elapsed < 1000) {
+			// nothing to do until the next millisecond is over, sleep if
+			// that doesn't make us late (the wait before the first timer 0
+			// overflow is never longer than 20 ms)
+			idle((ms > 20 ? 20000UL : ms * 1000) - elapsed);
+		}
+	}
+}
+
+void sleepUntil(unsigned long ms)
+{
+	for (;;) {
+		yield();
+		long left = (long)(ms - millis());
+		if (left <= 0)
+			break;
+#if defined(TIMER2_32KHZ_CRYSTAL) && defined(ASSR) && defined(AS2)
+		if (left > 2) {
+			// wake up a little early, the rest is done in IDLE mode
+			powersave(left - 2);
+			continue;
+		}
+#endif
+		// millis() only moves on when timer 0 overflows, so it is never
+		// too late to wake up at the next one
+		idle(0xFFFFFFFFUL);
 	}
 }
 
@@ -355,6 +593,16 @@ void init()
 	sbi(TCCR5A, WGM50);		// put timer 5 in 8-bit phase correct pwm mode
 #endif
 
+#if defined(CYCLE_COUNTER_TIMER)
+	// take the cycle counter timer back from pwm: normal mode, no prescaler
+	CC_TCCRB = 0;
+	CC_TCCRA = 0;
+	CC_TCNT = 0;
+	CC_TIFR = _BV(CC_TOV);
+	CC_TIMSK |= _BV(CC_TOIE);
+	CC_TCCRB = _BV(CC_CS0);
+#endif
+
 #if defined(ADCSRA)
 	// set a2d prescaler so we are inside the desired 50-200 KHz range.
 	#if F_CPU >= 16000000 // 16 MHz / 128 = 125 KHz
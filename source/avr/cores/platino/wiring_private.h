@@ -66,6 +66,17 @@ uint32_t countPulseASM(volatile uint8_t *port, uint8_t bit, uint8_t stateMask, u
 
 typedef void (*voidFuncPtr)(void);
 
+// Shared between the timer 0 overflow interrupt in wiring.c and the task
+// scheduler in Scheduler.c
+extern volatile unsigned long timer0_millis;
+extern volatile unsigned long scheduler_deadline;
+extern volatile uint8_t scheduler_armed;
+extern volatile uint8_t scheduler_due;
+
+// Number of running timers of SoftTimer.c, the timer 0 overflow interrupt
+// only moves the timer wheel on when there are any
+extern volatile uint8_t softtimer_active;
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
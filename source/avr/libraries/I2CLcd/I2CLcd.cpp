@@ -7,6 +7,8 @@
 *
 * History
 * 2014.09.08  ver 1.00    Preliminary version, first release
+*             ver 1.01    Shadow buffer, one I2C transaction per line
+*             ver 1.02    Execution time between bytes on a fast bus
 */
 
 #include "I2CLcd.h"
@@ -22,6 +24,12 @@ I2CLcd::I2CLcd(uint8_t resetPin, uint8_t backlightPin)
 	m_resetPin = resetPin;
 	pinMode(m_resetPin,OUTPUT);
 	reset(false); // Assert reset pin.
+
+	m_line = 0;
+	m_column = 0;
+	m_onOff = 0;
+	m_deferred = false;
+	m_timer = -1;
 }
 
 
@@ -56,8 +64,14 @@ void I2CLcd::begin(void)
 	// Display on.
 	//writeCommand(ST7032_CMD_ON_OFF,ST7032_DISPLAY_ON|ST7032_CURSOR_OFF|ST7032_BLINK_OFF);
 	displayCursorBlink(1,0,0);
-	// Clear display.
-	clear();
+	// Clear display, this is the only time the clear command is used
+	// so that the shadow is known to match the display.
+	writeCommand(ST7032_CMD_CLEAR,0);
+	delay(2);
+	memset(m_shadow,' ',sizeof(m_shadow));
+	m_dirty[0] = 0;
+	m_dirty[1] = 0;
+	setCursor(0,0);
 
 	// Check custom characters.
 	/*I2CLcd::displayCursorBlink(1,1,0);
@@ -71,7 +85,17 @@ void I2CLcd::begin(void)
 
 uint8_t I2CLcd::putChar(char ch)
 {
-	writeData(ch);
+	// Like the display, ignore what falls off the end of the line.
+	if (m_column<ST7032_CHARS_PER_LINE)
+	{
+		if (m_shadow[m_line][m_column]!=ch)
+		{
+			m_shadow[m_line][m_column] = ch;
+			m_dirty[m_line] |= 1U<<m_column;
+		}
+		m_column += 1;
+	}
+	if (m_deferred==false) while (update());
 	return 1;
 }
 
@@ -79,12 +103,17 @@ uint8_t I2CLcd::putChar(char ch)
 uint8_t I2CLcd::putString(char const *p_str)
 {
 	uint8_t result = 0;
+	bool deferred = m_deferred;
 
+	// Collect the whole string before sending anything.
+	m_deferred = true;
 	while (*p_str!=0)
 	{
-		writeData(*p_str++);
+		putChar(*p_str++);
 		result += 1;
 	}
+	m_deferred = deferred;
+	if (m_deferred==false) while (update());
 
 	return result;
 }
@@ -92,22 +121,133 @@ uint8_t I2CLcd::putString(char const *p_str)
 
 void I2CLcd::clear(void)
 {
-	writeCommand(ST7032_CMD_CLEAR,0);
-	delay(2);
+	// No clear command and its 2 ms wait, just blank what isn't blank.
+	bool deferred = m_deferred;
+	m_deferred = true;
+	for (uint8_t line=0; line<ST7032_LINES; line++)
+	{
+		setCursor(line,0);
+		for (uint8_t i=0; i<ST7032_CHARS_PER_LINE; i++) putChar(' ');
+	}
+	m_deferred = deferred;
+	if (m_deferred==false) while (update());
+	setCursor(0,0);
+	if (m_deferred==false) restoreCursor();
+}
+
+
+void I2CLcd::setCursor(uint8_t line, uint8_t column)
+{
+	m_line = line==0? 0 : 1;
+	m_column = column;
+}
+
+
+// The display needs ST7032_RESPONSE_TIME_NORMAL to execute a byte. On the
+// bus a byte takes 9 clocks, 90 us at 100 kHz but only 22.5 us at 400 kHz.
+bool I2CLcd::busIsSlow(void)
+{
+	// SCL period in CPU cycles, as set by Wire, which leaves the TWI
+	// prescaler at 1.
+	uint16_t scl = 16+2*TWBR;
+	return 9UL*scl>=ST7032_RESPONSE_TIME_NORMAL*(F_CPU/1000000UL);
 }
 
 
+// Sends size bytes after a single control byte, 0x00 for commands or
+// ST7032_CONTROL_RS for data. On a slow bus that is one transaction.
+// Otherwise every byte goes in a transaction of its own, followed by the
+// time the display needs to execute it.
+void I2CLcd::writeBytes(uint8_t control, const uint8_t *p_data, uint8_t size)
+{
+	uint8_t chunk = busIsSlow()? size : 1;
+	while (size>0)
+	{
+		uint8_t n = size<chunk? size : chunk;
+		Wire.beginTransmission(ST7032_I2C_ADDRESS);
+		Wire.write(control);
+		Wire.write(p_data,n);
+		Wire.endTransmission();
+		if (chunk==1) delayMicroseconds(ST7032_RESPONSE_TIME_NORMAL);
+		p_data += n;
+		size -= n;
+	}
+}
+
+
+// Put the display's address counter back at the text cursor after
+// update() has moved it, together with the on/off command.
+void I2CLcd::restoreCursor(void)
+{
+	uint8_t cmd[2];
+	cmd[0] = ST7032_CMD_DDRAM_ADDRESS|((m_line==0?0:0x40)+m_column);
+	cmd[1] = ST7032_CMD_ON_OFF|m_onOff;
+	writeBytes(0x00,cmd,2);
+}
+
+
+bool I2CLcd::update(void)
+{
+	for (uint8_t line=0; line<ST7032_LINES; line++)
+	{
+		uint16_t dirty = m_dirty[line];
+		if (dirty==0) continue;
+
+		// Everything from the first to the last changed character goes
+		// out in one go after the address, see writeBytes().
+		uint8_t first = 0;
+		while ((dirty&(1U<<first))==0) first++;
+		uint8_t last = ST7032_CHARS_PER_LINE-1;
+		while ((dirty&(1U<<last))==0) last--;
+		uint8_t cmd = ST7032_CMD_DDRAM_ADDRESS|((line==0?0:0x40)+first);
+		writeBytes(0x00,&cmd,1);
+		writeBytes(ST7032_CONTROL_RS,(const uint8_t *)&m_shadow[line][first],last-first+1);
+		m_dirty[line] = 0;
+
+		for (line+=1; line<ST7032_LINES; line++)
+		{
+			if (m_dirty[line]!=0) return true;
+		}
+		// A visible cursor must not stay where the text ended.
+		if ((m_onOff&(ST7032_CURSOR_ON|ST7032_BLINK_ON))!=0) restoreCursor();
+		return false;
+	}
+	return false;
+}
+
+
+#if defined(HAVE_CORE_SOFTTIMER)
+static void scheduledUpdate(void *p_lcd)
+{
+	((I2CLcd *)p_lcd)->update();
+}
+
+
+int8_t I2CLcd::scheduleUpdates(unsigned long period)
+{
+	if (m_timer>=0) softTimerCancel(m_timer);
+	m_timer = -1;
+	if (period==0) return -1;
+	m_deferred = true;
+	m_timer = softTimerStart(scheduledUpdate,this,period,period,SOFTTIMER_DEFERRED);
+	return m_timer;
+}
+#endif
+
+
 void I2CLcd::cursorMove(uint8_t line, uint8_t column)
 {
-	writeCommand(ST7032_CMD_DDRAM_ADDRESS,(line==0?0:0x40)+column);
-	displayCursorBlink(1,0,0);
+	setCursor(line,column);
+	m_onOff = ST7032_DISPLAY_ON;
+	if (m_deferred==false) restoreCursor();
 }
 
 
 void I2CLcd::cursor(uint8_t line, uint8_t column)
 {
-	writeCommand(ST7032_CMD_DDRAM_ADDRESS,(line==0?0:0x40)+column);
-	displayCursorBlink(1,0,0);
+	setCursor(line,column);
+	m_onOff = ST7032_DISPLAY_ON;
+	if (m_deferred==false) restoreCursor();
 }
 
 
@@ -118,6 +258,7 @@ void I2CLcd::displayCursorBlink(uint8_t display, uint8_t cursor, uint8_t blink)
 	// Beware of auto-increment. If you don't see the cursor, maybe it fell off the screen?
 	if (cursor!=0) cmd |= ST7032_CURSOR_ON;
 	if (blink!=0) cmd |= ST7032_BLINK_ON;
+	m_onOff = cmd;
 	writeCommand(ST7032_CMD_ON_OFF,cmd);
 }
 
@@ -125,11 +266,15 @@ void I2CLcd::displayCursorBlink(uint8_t display, uint8_t cursor, uint8_t blink)
 void I2CLcd::clearToEol(int line, int column)
 {
 	uint8_t i;
+	bool deferred = m_deferred;
+	m_deferred = true;
 	cursorMove(line,column);
 	for (i=column; i<ST7032_CHARS_PER_LINE; i++)
 	{
 		putChar(' ');
 	}
+	m_deferred = deferred;
+	if (m_deferred==false) while (update());
 	cursorMove(line,column);
 }
 
@@ -153,16 +298,20 @@ void I2CLcd::font(uint8_t font)
 void I2CLcd::setCustomCharacter(uint8_t index, const uint8_t *p_data)
 {
 	int i;
+	uint8_t cmd[2];
+	uint8_t data[7];
 	// Up to 8 custom characters may be defined.
 	// Select function table 0.
-	writeCommand(ST7032_CMD_FUNCTION,ST7032_FUNC_CONFIG_NORMAL);
+	cmd[0] = ST7032_CMD_FUNCTION|ST7032_FUNC_CONFIG_NORMAL;
 	// Set CGRAM address.
-	writeCommand(ST7032_CMD_CGRAM_ADDRESS,(8*index)&0x3f);
-	// 8 bytes per character.
+	cmd[1] = ST7032_CMD_CGRAM_ADDRESS|((8*index)&0x3f);
+	writeBytes(0x00,cmd,2);
+	// 8 bytes per character, all behind a single data control byte.
 	for (i=0; i<7; i++)
 	{
-		writeData(p_data[i]&0x1f);
+		data[i] = p_data[i]&0x1f;
 	}
+	writeBytes(ST7032_CONTROL_RS,data,7);
 }
 
 
@@ -171,6 +320,8 @@ void I2CLcd::bargraph(uint8_t position, uint8_t value, uint8_t value_max)
 	//writeCommand(ST7032_CMD_ON_OFF,ST7032_DISPLAY_ON|ST7032_CURSOR_OFF|ST7032_BLINK_OFF);
 	uint16_t v = value;
 	v = 14*v/value_max; // map [1,255] to 14 possibilities, 0 is possibility 15.
+	bool deferred = m_deferred;
+	m_deferred = true;
 	cursor(1,position);
 	if (v<=6)
 	{
@@ -198,4 +349,6 @@ void I2CLcd::bargraph(uint8_t position, uint8_t value, uint8_t value_max)
 		else if (v>7) v = 7; //'M';
 		putChar(v);
 	}
+	m_deferred = deferred;
+	if (m_deferred==false) while (update());
 }
@@ -7,6 +7,8 @@
 *
 * History
 * 2014.09.08  ver 1.00    Preliminary version, first release
+*             ver 1.01    Shadow buffer, one I2C transaction per line
+*             ver 1.02    Execution time between bytes on a fast bus
 */
 
 #ifndef __I2CLCD_H__
@@ -19,6 +21,7 @@
 
 #define ST7032_I2C_ADDRESS  (0x3e)
 #define ST7032_CHARS_PER_LINE  (16)
+#define ST7032_LINES  (2)
 
 // The speed of the display depends on the frequency of its internal oscillator.
 #define ST7032_FOSC  (192000) /* [Hz], can be tweaked if extended mode is available. */
@@ -80,6 +83,10 @@
 #define ST7032_CMD_DDRAM_ADDRESS  (0x80)
 #define ST7032_DDRAM_ADDRESS_MASK  (0x7f)
 
+// Control byte that precedes every command or data byte on the bus.
+#define ST7032_CONTROL_CO  (0x80) /* Another control byte follows the next byte. */
+#define ST7032_CONTROL_RS  (0x40) /* Data register instead of instruction register. */
+
 // Bias selection/Internal OSC frequency adjust (extended function)
 #define ST7032_CMD_BIAS_OSC  (0x10)
 #define ST7032_BIAS_020  (0x00) /* default */
@@ -128,10 +135,38 @@ public:
 	void font(uint8_t font);
 	void setCustomCharacter(uint8_t index, const uint8_t *p_data);
 	void bargraph(uint8_t position, uint8_t value, uint8_t valueMax);
+
+	// Text goes to a copy of the display in RAM first and only the
+	// characters that changed are sent, in one run of bytes per line.
+	// Normally that happens before putChar(), putString() and clear()
+	// return. With deferUpdates(true) they only change the copy and
+	// update() has to be called to send it, one line per call. update()
+	// returns true while lines are left.
+	void deferUpdates(bool defer) { m_deferred = defer; }
+	bool update(void);
+#if defined(HAVE_CORE_SOFTTIMER)
+	// Defers updates and has a soft timer of the core call update() every
+	// period ms, from yield() and after loop(). Calling it again replaces
+	// the timer, a period of 0 stops it. Returns the timer id, -1 when
+	// there is none.
+	int8_t scheduleUpdates(unsigned long period);
+#endif
 	
 protected:
 	uint8_t m_backlightPin;
 	uint8_t m_resetPin;
+	char m_shadow[ST7032_LINES][ST7032_CHARS_PER_LINE];
+	uint16_t m_dirty[ST7032_LINES]; // One bit per column that differs from the display.
+	uint8_t m_line;
+	uint8_t m_column;
+	uint8_t m_onOff; // Last display/cursor/blink setting.
+	bool m_deferred;
+	int8_t m_timer; // Soft timer of scheduleUpdates(), -1 when none.
+
+	void setCursor(uint8_t line, uint8_t column);
+	void restoreCursor(void);
+	bool busIsSlow(void);
+	void writeBytes(uint8_t control, const uint8_t *p_data, uint8_t size);
 
 	void writeByte(uint8_t cmdOrData, uint8_t value)
 	{
@@ -62,6 +62,17 @@ static const uint8_t A7 = 21;
 
 #define digitalPinToInterrupt(p)  ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
 
+// Compile time copies of the digital_pin_to_*_PGM tables below, used by
+// FastPin.h.  Keep them in step with the tables.
+#define fastPinPort(p)  (((p) <= 7) ? 'D' : (((p) <= 13) ? 'B' : (((p) <= 19) ? 'C' : 0)))
+#define fastPinBit(p)   (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+#if defined(__AVR_ATmega8__)
+#define fastPinTimer(p) (((p) == 9) ? TIMER1A : (((p) == 10) ? TIMER1B : (((p) == 11) ? TIMER2 : NOT_ON_TIMER)))
+#else
+#define fastPinTimer(p) (((p) == 3) ? TIMER2B : (((p) == 5) ? TIMER0B : (((p) == 6) ? TIMER0A : \
+                        (((p) == 9) ? TIMER1A : (((p) == 10) ? TIMER1B : (((p) == 11) ? TIMER2A : NOT_ON_TIMER))))))
+#endif
+
 #ifdef ARDUINO_MAIN
 
 // On the Arduino board, digital pins are also used
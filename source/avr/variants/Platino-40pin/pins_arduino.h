@@ -73,6 +73,14 @@ These macros are used by at least the SoftwareSerial library.
 #define digitalPinToPCMSKbit(p) (((p)<=7)? (p) : (((p)<=13)? ((p)-8) : (((p)<=21)? ((p)-14) : (((p)<=23)? ((p)-8) : (31-(p))))))
 #endif
 
+// Compile time copies of the digital_pin_to_*_PGM tables below, used by
+// FastPin.h.  Keep them in step with the tables.
+#define fastPinPort(p)  (((p)<=7)? 'D' : (((p)<=13)? 'B' : (((p)<=21)? 'C' : (((p)<=23)? 'B' : (((p)<=31)? 'A' : 0)))))
+// Note: Port A is numbered in reverse, i.e. D24..31 = PA7..0
+#define fastPinBit(p)   (((p)<=7)? (p) : (((p)<=13)? ((p)-8) : (((p)<=21)? ((p)-14) : (((p)<=23)? ((p)-16) : (31-(p))))))
+#define fastPinTimer(p) (((p)==4)? TIMER1B : (((p)==5)? TIMER1A : (((p)==6)? TIMER2B : (((p)==7)? TIMER2A : \
+                        (((p)==11)? TIMER0A : (((p)==12)? TIMER0B : NOT_ON_TIMER))))))
+
 #ifdef ARDUINO_MAIN
 
 // On the Arduino board, digital pins are also used
@@ -132,6 +132,10 @@ void analogWrite(uint8_t, int);
 unsigned long millis(void);
 unsigned long micros(void);
 void delay(unsigned long);
+void sleepUntil(unsigned long ms);
+#if defined(CYCLE_COUNTER_TIMER)
+unsigned long cycleCount(void);
+#endif
 void delayMicroseconds(unsigned int us);
 unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
 unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout);
@@ -245,8 +249,18 @@ long random(long, long);
 void randomSeed(unsigned long);
 long map(long, long, long, long, long);
 
+#if defined(RAM_REPORT)
+#include "new.h"
+
+// Print the RAM layout and the deepest the stack has gone since reset.
+void ramReport(Print &out);
+#endif
+
 #endif
 
 #include "pins_arduino.h"
+#include "Profile.h"
+#include "CoreScheduler.h"
+#include "CoreSoftTimer.h"
 
 #endif
@@ -60,6 +60,8 @@
   bool Serial3_available() __attribute__((weak));
 #endif
 
+volatile uint8_t _serial_event_pending = 0;
+
 void serialEventRun(void)
 {
 #if defined(HAVE_HWSERIAL0)
@@ -76,28 +78,6 @@ void serialEventRun(void)
 #endif
 }
 
-// Actual interrupt handlers //////////////////////////////////////////////////////////////
-
-void HardwareSerial::_tx_udr_empty_irq(void)
-{
-  // If interrupts are enabled, there must be more data in the output
-  // buffer. Send the next byte
-  unsigned char c = _tx_buffer[_tx_buffer_tail];
-  _tx_buffer_tail = (_tx_buffer_tail + 1) % SERIAL_TX_BUFFER_SIZE;
-
-  *_udr = c;
-
-  // clear the TXC bit -- "can be cleared by writing a one to its bit
-  // location". This makes sure flush() won't return until the bytes
-  // actually got written
-  sbi(*_ucsra, TXC0);
-
-  if (_tx_buffer_head == _tx_buffer_tail) {
-    // Buffer empty, so disable interrupts
-    cbi(*_ucsrb, UDRIE0);
-  }
-}
-
 // Public Methods //////////////////////////////////////////////////////////////
 
 void HardwareSerial::begin(unsigned long baud, byte config)
@@ -133,6 +113,14 @@ void HardwareSerial::begin(unsigned long baud, byte config)
   sbi(*_ucsrb, TXEN0);
   sbi(*_ucsrb, RXCIE0);
   cbi(*_ucsrb, UDRIE0);
+
+  // end() doesn't forget the driver enable pin or the address, but it
+  // turns the TX complete interrupt off. Start in plain 8 bit mode (the
+  // UCSRA write above cleared MPCM) and rearm the pin.
+  _mp_slave = false;
+  cbi(*_ucsrb, UCSZ02);
+  if (_de_mask)
+    sbi(*_ucsrb, TXCIE0);
 }
 
 void HardwareSerial::end()
@@ -144,107 +132,74 @@ void HardwareSerial::end()
   cbi(*_ucsrb, TXEN0);
   cbi(*_ucsrb, RXCIE0);
   cbi(*_ucsrb, UDRIE0);
+  cbi(*_ucsrb, TXCIE0);
+  if (_de_mask)
+    *_de_port &= ~_de_mask;
   
-  // clear any received data
-  _rx_buffer_head = _rx_buffer_tail;
+  // clear any received data, nothing comes in with the receiver off
+  while (read() >= 0)
+    ;
 }
 
-int HardwareSerial::available(void)
+void HardwareSerial::setDriverEnablePin(int pin)
 {
-  return ((unsigned int)(SERIAL_RX_BUFFER_SIZE + _rx_buffer_head - _rx_buffer_tail)) % SERIAL_RX_BUFFER_SIZE;
-}
-
-int HardwareSerial::peek(void)
-{
-  if (_rx_buffer_head == _rx_buffer_tail) {
-    return -1;
-  } else {
-    return _rx_buffer[_rx_buffer_tail];
-  }
-}
+  // don't pull the pin out from under a transmission
+  flush();
 
-int HardwareSerial::read(void)
-{
-  // if the head isn't ahead of the tail, we don't have any characters
-  if (_rx_buffer_head == _rx_buffer_tail) {
-    return -1;
-  } else {
-    unsigned char c = _rx_buffer[_rx_buffer_tail];
-    _rx_buffer_tail = (rx_buffer_index_t)(_rx_buffer_tail + 1) % SERIAL_RX_BUFFER_SIZE;
-    return c;
+  uint8_t oldSREG = SREG;
+  cli();
+  cbi(*_ucsrb, TXCIE0);
+  if (_de_mask)
+    *_de_port &= ~_de_mask;
+  _de_mask = 0;
+  if (pin >= 0) {
+    uint8_t port = digitalPinToPort(pin);
+    if (port != NOT_A_PIN) {
+      _de_port = portOutputRegister(port);
+      _de_mask = digitalPinToBitMask(pin);
+      *_de_port &= ~_de_mask;
+      *portModeRegister(port) |= _de_mask;
+      sbi(*_ucsrb, TXCIE0);
+    }
   }
+  SREG = oldSREG;
 }
 
-int HardwareSerial::availableForWrite(void)
+#if SERIAL_STATS
+void HardwareSerial::getStats(SerialStats &stats)
 {
-#if (SERIAL_TX_BUFFER_SIZE>256)
   uint8_t oldSREG = SREG;
   cli();
-#endif
-  tx_buffer_index_t head = _tx_buffer_head;
-  tx_buffer_index_t tail = _tx_buffer_tail;
-#if (SERIAL_TX_BUFFER_SIZE>256)
+  stats = _stats;
   SREG = oldSREG;
-#endif
-  if (head >= tail) return SERIAL_TX_BUFFER_SIZE - 1 - head + tail;
-  return tail - head - 1;
 }
 
-void HardwareSerial::flush()
+void HardwareSerial::clearStats(void)
 {
-  // If we have never written a byte, no need to flush. This special
-  // case is needed since there is no way to force the TXC (transmit
-  // complete) bit to 1 during initialization
-  if (!_written)
-    return;
-
-  while (bit_is_set(*_ucsrb, UDRIE0) || bit_is_clear(*_ucsra, TXC0)) {
-    if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsrb, UDRIE0))
-	// Interrupts are globally disabled, but the DR empty
-	// interrupt should be enabled, so poll the DR empty flag to
-	// prevent deadlock
-	if (bit_is_set(*_ucsra, UDRE0))
-	  _tx_udr_empty_irq();
-  }
-  // If we get here, nothing is queued anymore (DRIE is disabled) and
-  // the hardware finished tranmission (TXC is set).
+  uint8_t oldSREG = SREG;
+  cli();
+  memset(&_stats, 0, sizeof(_stats));
+  SREG = oldSREG;
 }
+#endif
 
-size_t HardwareSerial::write(uint8_t c)
+void HardwareSerial::setAddress(int address)
 {
-  _written = true;
-  // If the buffer and the data register is empty, just write the byte
-  // to the data register and be done. This shortcut helps
-  // significantly improve the effective datarate at high (>
-  // 500kbit/s) bitrates, where interrupt overhead becomes a slowdown.
-  if (_tx_buffer_head == _tx_buffer_tail && bit_is_set(*_ucsra, UDRE0)) {
-    *_udr = c;
-    sbi(*_ucsra, TXC0);
-    return 1;
-  }
-  tx_buffer_index_t i = (_tx_buffer_head + 1) % SERIAL_TX_BUFFER_SIZE;
-	
-  // If the output buffer is full, there's nothing for it other than to 
-  // wait for the interrupt handler to empty it a bit
-  while (i == _tx_buffer_tail) {
-    if (bit_is_clear(SREG, SREG_I)) {
-      // Interrupts are disabled, so we'll have to poll the data
-      // register empty flag ourselves. If it is set, pretend an
-      // interrupt has happened and call the handler to free up
-      // space for us.
-      if(bit_is_set(*_ucsra, UDRE0))
-	_tx_udr_empty_irq();
-    } else {
-      // nop, the interrupt handler will free up space for us
-    }
+  uint8_t oldSREG = SREG;
+  cli();
+  // Keep TXC out of the UCSRA writes, see _rx_complete_irq()
+  uint8_t ucsra = *_ucsra & (_BV(U2X0) | _BV(MPCM0));
+  if (address < 0) {
+    _mp_slave = false;
+    *_ucsra = ucsra & ~_BV(MPCM0);
+    cbi(*_ucsrb, UCSZ02);
+  } else {
+    _mp_address = address;
+    _mp_slave = true;
+    sbi(*_ucsrb, UCSZ02);
+    *_ucsra = ucsra | _BV(MPCM0);
   }
-
-  _tx_buffer[_tx_buffer_head] = c;
-  _tx_buffer_head = i;
-	
-  sbi(*_ucsrb, UDRIE0);
-  
-  return 1;
+  SREG = oldSREG;
 }
 
 #endif // whole file
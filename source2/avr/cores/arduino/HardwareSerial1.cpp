@@ -36,29 +36,61 @@
 
 #if defined(HAVE_HWSERIAL1)
 
+#if defined(SERIAL1_FAST_ISR)
+#if (SERIAL1_RX_BUFFER_SIZE > 256) || (SERIAL1_RX_BUFFER_SIZE & (SERIAL1_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL1_TX_BUFFER_SIZE > 256) || (SERIAL1_TX_BUFFER_SIZE & (SERIAL1_TX_BUFFER_SIZE - 1))
+#error "SERIAL1_FAST_ISR needs power of two buffer sizes of at most 256 bytes"
+#endif
+#if SERIAL_STATS
+#error "SERIAL1_FAST_ISR doesn't keep statistics"
+#endif
+#define SERIAL1_ISR_FLAGS ISR_NAKED
+#else
+#define SERIAL1_ISR_FLAGS ISR_BLOCK
+#endif
+
 #if defined(UART1_RX_vect)
-ISR(UART1_RX_vect)
+ISR(UART1_RX_vect, SERIAL1_ISR_FLAGS)
 #elif defined(USART1_RX_vect)
-ISR(USART1_RX_vect)
+ISR(USART1_RX_vect, SERIAL1_ISR_FLAGS)
 #else
 #error "Don't know what the Data Register Empty vector is called for Serial1"
 #endif
 {
+#if defined(SERIAL1_FAST_ISR)
+  Serial1._rx_complete_irq_fast(_SFR_MEM_ADDR(UCSR1A), _SFR_MEM_ADDR(UDR1));
+#else
   Serial1._rx_complete_irq();
+#endif
 }
 
 #if defined(UART1_UDRE_vect)
-ISR(UART1_UDRE_vect)
+ISR(UART1_UDRE_vect, SERIAL1_ISR_FLAGS)
 #elif defined(USART1_UDRE_vect)
-ISR(USART1_UDRE_vect)
+ISR(USART1_UDRE_vect, SERIAL1_ISR_FLAGS)
 #else
 #error "Don't know what the Data Register Empty vector is called for Serial1"
 #endif
 {
+#if defined(SERIAL1_FAST_ISR)
+  Serial1._tx_udr_empty_irq_fast(_SFR_MEM_ADDR(UCSR1A), _SFR_MEM_ADDR(UCSR1B), _SFR_MEM_ADDR(UDR1));
+#else
   Serial1._tx_udr_empty_irq();
+#endif
+}
+
+#if defined(UART1_TX_vect)
+ISR(UART1_TX_vect)
+#elif defined(USART1_TX_vect)
+ISR(USART1_TX_vect)
+#else
+  #error "Don't know what the Transmit Complete vector is called for Serial1"
+#endif
+{
+  Serial1._tx_complete_irq();
 }
 
-HardwareSerial Serial1(&UBRR1H, &UBRR1L, &UCSR1A, &UCSR1B, &UCSR1C, &UDR1);
+HardwareSerial1 Serial1(&UBRR1H, &UBRR1L, &UCSR1A, &UCSR1B, &UCSR1C, &UDR1);
 
 // Function that can be weakly referenced by serialEventRun to prevent
 // pulling in this file if it's not otherwise used.
@@ -36,17 +36,49 @@
 
 #if defined(HAVE_HWSERIAL3)
 
-ISR(USART3_RX_vect)
+#if defined(SERIAL3_FAST_ISR)
+#if (SERIAL3_RX_BUFFER_SIZE > 256) || (SERIAL3_RX_BUFFER_SIZE & (SERIAL3_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL3_TX_BUFFER_SIZE > 256) || (SERIAL3_TX_BUFFER_SIZE & (SERIAL3_TX_BUFFER_SIZE - 1))
+#error "SERIAL3_FAST_ISR needs power of two buffer sizes of at most 256 bytes"
+#endif
+#if SERIAL_STATS
+#error "SERIAL3_FAST_ISR doesn't keep statistics"
+#endif
+#define SERIAL3_ISR_FLAGS ISR_NAKED
+#else
+#define SERIAL3_ISR_FLAGS ISR_BLOCK
+#endif
+
+ISR(USART3_RX_vect, SERIAL3_ISR_FLAGS)
 {
+#if defined(SERIAL3_FAST_ISR)
+  Serial3._rx_complete_irq_fast(_SFR_MEM_ADDR(UCSR3A), _SFR_MEM_ADDR(UDR3));
+#else
   Serial3._rx_complete_irq();
+#endif
 }
 
-ISR(USART3_UDRE_vect)
+ISR(USART3_UDRE_vect, SERIAL3_ISR_FLAGS)
 {
+#if defined(SERIAL3_FAST_ISR)
+  Serial3._tx_udr_empty_irq_fast(_SFR_MEM_ADDR(UCSR3A), _SFR_MEM_ADDR(UCSR3B), _SFR_MEM_ADDR(UDR3));
+#else
   Serial3._tx_udr_empty_irq();
+#endif
+}
+
+#if defined(UART3_TX_vect)
+ISR(UART3_TX_vect)
+#elif defined(USART3_TX_vect)
+ISR(USART3_TX_vect)
+#else
+  #error "Don't know what the Transmit Complete vector is called for Serial3"
+#endif
+{
+  Serial3._tx_complete_irq();
 }
 
-HardwareSerial Serial3(&UBRR3H, &UBRR3L, &UCSR3A, &UCSR3B, &UCSR3C, &UDR3);
+HardwareSerial3 Serial3(&UBRR3H, &UBRR3L, &UCSR3A, &UCSR3B, &UCSR3C, &UDR3);
 
 // Function that can be weakly referenced by serialEventRun to prevent
 // pulling in this file if it's not otherwise used.
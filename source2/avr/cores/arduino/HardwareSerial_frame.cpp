@@ -0,0 +1,82 @@
+/*
+  HardwareSerial_frame.cpp - Idle-line frame detection for HardwareSerial
+  Copyright (c) 2006 Nicholas Zambetti.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+#include "HardwareSerial_private.h"
+
+// This is in its own file so that the timer 2 compare B vector and the
+// code behind it are only linked in when a sketch calls setFrameGap().
+
+#if defined(HAVE_HWSERIAL_FRAMES)
+
+// The port that owns timer 2, if any, and its handler. A function
+// pointer rather than a virtual, so that ports that never call
+// setFrameGap() don't get the handler linked in.
+static HardwareSerial * volatile _frame_port = NULL;
+static void (* volatile _frame_irq)(HardwareSerial *);
+
+ISR(TIMER2_COMPB_vect)
+{
+  HardwareSerial *port = _frame_port;
+  if (port)
+    _frame_irq(port);
+  else
+    TIMSK2 &= ~_BV(OCIE2B);
+}
+
+void HardwareSerial::_set_frame_gap(uint8_t half_chars, void (*callback)(void), void (*irq)(HardwareSerial *))
+{
+  // Length of one bit in CPU cycles, from the baud rate registers.
+  uint32_t bit_cycles = ((((uint16_t)(*_ubrrh & 0x0F)) << 8) | *_ubrrl) + 1;
+  bit_cycles *= bit_is_set(*_ucsra, U2X0) ? 8 : 16;
+
+  // Length of one character in bits: start bit, 5 to 8 data bits (UCSZ1:0),
+  // parity bit (UPM1) and 1 or 2 stop bits (USBS).
+  uint8_t config = *_ucsrc;
+  uint8_t char_bits = 1 + 5 + ((config >> 1) & 0x03) + ((config & 0x20) ? 1 : 0) + ((config & 0x08) ? 2 : 1);
+
+  // Timer 2 ticks every 64 CPU cycles, set up below
+  uint32_t ticks = (bit_cycles * char_bits * half_chars / 2 + 63) / 64;
+  if (ticks > 0xFFFF)
+    ticks = 0xFFFF;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  if (_frame_port && _frame_port != this)
+    _frame_port->_frame_gap = 0;
+  TIMSK2 &= ~_BV(OCIE2B);
+  _frame_gap = ticks;
+  _frame_callback = callback;
+  if (ticks) {
+    // Normal mode, where OCR2B is not double buffered but counts from
+    // the moment it is written, with the prescaler at 64.
+    TCCR2A = 0;
+    TCCR2B = _BV(CS22);
+    _frame_irq = irq;
+    _frame_port = this;
+  } else if (_frame_port == this) {
+    // Back to the phase correct PWM that init() set up
+    TCCR2A = _BV(WGM20);
+    _frame_port = NULL;
+  }
+  SREG = oldSREG;
+}
+
+#endif // HAVE_HWSERIAL_FRAMES
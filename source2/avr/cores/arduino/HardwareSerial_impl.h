@@ -0,0 +1,508 @@
+/*
+  HardwareSerial_impl.h - Hardware serial library for Wiring
+  Copyright (c) 2006 Nicholas Zambetti.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+  Modified 23 November 2006 by David A. Mellis
+  Modified 28 September 2010 by Mark Sproul
+  Modified 14 August 2012 by Alarus
+  Modified 3 December 2013 by Matthijs Kooijman
+*/
+
+// Member functions of HardwareSerialT. These depend on the buffer sizes,
+// so they live in a header that is included by HardwareSerial.h and get
+// instantiated once for every distinct pair of sizes in use.
+
+#ifndef HardwareSerial_impl_h
+#define HardwareSerial_impl_h
+
+#include <string.h>
+
+#ifndef cbi
+#define cbi(sfr, bit) (_SFR_BYTE(sfr) &= ~_BV(bit))
+#endif
+#ifndef sbi
+#define sbi(sfr, bit) (_SFR_BYTE(sfr) |= _BV(bit))
+#endif
+
+// Ensure that the various bit positions we use are available with a 0
+// postfix, so we can always use the values for UART0 for all UARTs. The
+// alternative, passing the various values for each UART to the
+// HardwareSerial constructor also works, but makes the code bigger and
+// slower.
+#if !defined(TXC0)
+#if defined(TXC)
+// Some chips like ATmega8 don't have UPE, only PE. The other bits are
+// named as expected.
+#if !defined(UPE) && defined(PE)
+#define UPE PE
+#endif
+// On ATmega8, the uart and its bits are not numbered, so there is no TXC0 etc.
+#define TXC0 TXC
+#define RXEN0 RXEN
+#define TXEN0 TXEN
+#define RXCIE0 RXCIE
+#define UDRIE0 UDRIE
+#define U2X0 U2X
+#define UPE0 UPE
+#define UDRE0 UDRE
+#define TXCIE0 TXCIE
+#define MPCM0 MPCM
+#define UCSZ02 UCSZ2
+#define RXB80 RXB8
+#define TXB80 TXB8
+#define DOR0 DOR
+#define FE0 FE
+#elif defined(TXC1)
+// Some devices have uart1 but no uart0
+#define TXC0 TXC1
+#define RXEN0 RXEN1
+#define TXEN0 TXEN1
+#define RXCIE0 RXCIE1
+#define UDRIE0 UDRIE1
+#define U2X0 U2X1
+#define UPE0 UPE1
+#define UDRE0 UDRE1
+#define TXCIE0 TXCIE1
+#define MPCM0 MPCM1
+#define UCSZ02 UCSZ12
+#define RXB80 RXB81
+#define TXB80 TXB81
+#define DOR0 DOR1
+#define FE0 FE1
+#else
+#error No UART found in HardwareSerial.cpp
+#endif
+#endif // !defined TXC0
+
+// Check at compiletime that it is really ok to use the bit positions of
+// UART0 for the other UARTs as well, in case these values ever get
+// changed for future hardware.
+#if defined(TXC1) && (TXC1 != TXC0 || RXEN1 != RXEN0 || RXCIE1 != RXCIE0 || \
+		      UDRIE1 != UDRIE0 || U2X1 != U2X0 || UPE1 != UPE0 || \
+		      UDRE1 != UDRE0)
+#error "Not all bit positions for UART1 are the same as for UART0"
+#endif
+#if defined(TXC2) && (TXC2 != TXC0 || RXEN2 != RXEN0 || RXCIE2 != RXCIE0 || \
+		      UDRIE2 != UDRIE0 || U2X2 != U2X0 || UPE2 != UPE0 || \
+		      UDRE2 != UDRE0)
+#error "Not all bit positions for UART2 are the same as for UART0"
+#endif
+#if defined(TXC3) && (TXC3 != TXC0 || RXEN3 != RXEN0 || RXCIE3 != RXCIE0 || \
+		      UDRIE3 != UDRIE0 || U3X3 != U3X0 || UPE3 != UPE0 || \
+		      UDRE3 != UDRE0)
+#error "Not all bit positions for UART3 are the same as for UART0"
+#endif
+
+// Actual interrupt handlers //////////////////////////////////////////////////////////////
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::_tx_udr_empty_irq(void)
+{
+  PROFILE_SCOPE(PROFILE_ID_SERIAL_UDRE);
+  // If interrupts are enabled, there must be more data in the output
+  // buffer. Send the next byte
+  unsigned char c = _tx_buffer[_tx_buffer_tail];
+  _tx_buffer_tail = (_tx_buffer_tail + 1) % TX_SIZE;
+
+  *_udr = c;
+
+  // clear the TXC bit -- "can be cleared by writing a one to its bit
+  // location". This makes sure flush() won't return until the bytes
+  // actually got written
+  sbi(*_ucsra, TXC0);
+
+  if (_tx_buffer_head == _tx_buffer_tail) {
+    // Buffer empty, so disable interrupts
+    cbi(*_ucsrb, UDRIE0);
+  }
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::_tx_complete_irq(void)
+{
+  // The last stop bit is out and nothing followed it into the data
+  // register. Unless more bytes got queued meanwhile, release the bus.
+  if (_tx_buffer_head == _tx_buffer_tail)
+    *_de_port &= ~_de_mask;
+}
+
+#if defined(HAVE_HWSERIAL_FRAMES)
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::_frame_gap_irq(void)
+{
+  if (_frame_laps) {
+    // Not there yet, the next match is 256 ticks away
+    _frame_laps--;
+    return;
+  }
+  TIMSK2 &= ~_BV(OCIE2B);
+
+  // The line has been idle long enough, so the bytes received since the
+  // last gap form a frame. When the queue is full the boundary is lost
+  // and these bytes become part of the next frame.
+  uint8_t i = (_frame_head + 1) % SERIAL_FRAME_QUEUE_SIZE;
+  if (i != _frame_tail) {
+    _frame_len[_frame_head] = _frame_count;
+    _frame_head = i;
+    _frame_count = 0;
+  }
+  if (_frame_callback)
+    _frame_callback();
+}
+#endif
+
+// Public Methods //////////////////////////////////////////////////////////////
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+int HardwareSerialT<RX_SIZE, TX_SIZE>::available(void)
+{
+  rx_buffer_index_t head = _serial_index_load(_rx_buffer_head);
+  return ((unsigned int)(RX_SIZE + head - _rx_buffer_tail)) % RX_SIZE;
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+int HardwareSerialT<RX_SIZE, TX_SIZE>::peek(void)
+{
+  if (_serial_index_load(_rx_buffer_head) == _rx_buffer_tail) {
+    return -1;
+  } else {
+    return _rx_buffer[_rx_buffer_tail];
+  }
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+int HardwareSerialT<RX_SIZE, TX_SIZE>::read(void)
+{
+  // if the head isn't ahead of the tail, we don't have any characters
+  if (_serial_index_load(_rx_buffer_head) == _rx_buffer_tail) {
+    return -1;
+  } else {
+    unsigned char c = _rx_buffer[_rx_buffer_tail];
+    _serial_index_store(_rx_buffer_tail, (rx_buffer_index_t)(_rx_buffer_tail + 1) % RX_SIZE);
+    return c;
+  }
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+size_t HardwareSerialT<RX_SIZE, TX_SIZE>::rxSpan(const uint8_t **data)
+{
+  rx_buffer_index_t head = _serial_index_load(_rx_buffer_head);
+  rx_buffer_index_t tail = _rx_buffer_tail;
+
+  *data = _rx_buffer + tail;
+  // When the data wraps around, only the part up to the end of the
+  // buffer is contiguous, the rest follows at the next call.
+  if (head >= tail) return head - tail;
+  return RX_SIZE - tail;
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::consume(size_t n)
+{
+  size_t avail = HardwareSerialT::available();
+  if (n > avail)
+    n = avail;
+  // Only we write the tail, the ISR just reads it, so a single (atomic)
+  // store is enough to hand the freed space back.
+  _serial_index_store(_rx_buffer_tail, (rx_buffer_index_t)((_rx_buffer_tail + n) % RX_SIZE));
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+size_t HardwareSerialT<RX_SIZE, TX_SIZE>::readAvailable(uint8_t *buffer, size_t length)
+{
+  size_t count = 0;
+  // At most two rounds: up to the end of the ring, then from its start.
+  while (count < length) {
+    const uint8_t *data;
+    size_t n = HardwareSerialT::rxSpan(&data);
+    if (n == 0)
+      break;
+    if (n > length - count)
+      n = length - count;
+    memcpy(buffer + count, data, n);
+    HardwareSerialT::consume(n);
+    count += n;
+  }
+  return count;
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+size_t HardwareSerialT<RX_SIZE, TX_SIZE>::readBytes(char *buffer, size_t length)
+{
+  size_t count = 0;
+  while (count < length) {
+    size_t n = HardwareSerialT::readAvailable((uint8_t *)buffer + count, length - count);
+    if (n > 0) {
+      count += n;
+      continue;
+    }
+    int c = timedRead();
+    if (c < 0) break;
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+#if defined(HAVE_HWSERIAL_FRAMES)
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+int HardwareSerialT<RX_SIZE, TX_SIZE>::frameAvailable(void)
+{
+  // The ISR only writes the slot at _frame_head, which is not the one at
+  // _frame_tail unless the queue is empty, so this needs no guard.
+  if (_frame_head == _frame_tail)
+    return 0;
+  return _frame_len[_frame_tail];
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+size_t HardwareSerialT<RX_SIZE, TX_SIZE>::readFrame(uint8_t *buffer, size_t size)
+{
+  size_t len = HardwareSerialT::frameAvailable();
+  if (len == 0)
+    return 0;
+
+  size_t n = HardwareSerialT::readAvailable(buffer, len < size ? len : size);
+  HardwareSerialT::consume(len - n);
+  _frame_tail = (_frame_tail + 1) % SERIAL_FRAME_QUEUE_SIZE;
+  return n;
+}
+#endif
+
+#if SERIAL_STATS
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::_tx_stats(size_t queued)
+{
+  uint16_t fill = TX_SIZE - 1 - HardwareSerialT::availableForWrite();
+  // tx_bytes and tx_peak are only written here, so no need to keep the
+  // ISR out
+  _stats.tx_bytes += queued;
+  if (fill > _stats.tx_peak)
+    _stats.tx_peak = fill;
+}
+#endif
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+int HardwareSerialT<RX_SIZE, TX_SIZE>::availableForWrite(void)
+{
+  tx_buffer_index_t head = _tx_buffer_head;
+  tx_buffer_index_t tail = _serial_index_load(_tx_buffer_tail);
+  if (head >= tail) return TX_SIZE - 1 - head + tail;
+  return tail - head - 1;
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+void HardwareSerialT<RX_SIZE, TX_SIZE>::flush()
+{
+  // If we have never written a byte, no need to flush. This special
+  // case is needed since there is no way to force the TXC (transmit
+  // complete) bit to 1 during initialization
+  if (!_written)
+    return;
+
+  // With a driver enable pin, the TX complete interrupt is enabled and
+  // clears TXC when it runs, so wait for it to release the pin instead.
+  while (bit_is_set(*_ucsrb, UDRIE0) ||
+         (_de_mask ? (*_de_port & _de_mask) : bit_is_clear(*_ucsra, TXC0))) {
+    if (bit_is_clear(SREG, SREG_I)) {
+      // Interrupts are globally disabled, so poll the flags of the
+      // interrupts that should be enabled to prevent deadlock
+      if (bit_is_set(*_ucsrb, UDRIE0)) {
+	if (bit_is_set(*_ucsra, UDRE0))
+	  _tx_udr_empty_irq();
+      } else if (_de_mask && bit_is_set(*_ucsra, TXC0)) {
+	sbi(*_ucsra, TXC0);
+	_tx_complete_irq();
+      }
+    }
+  }
+  // If we get here, nothing is queued anymore (DRIE is disabled) and
+  // the hardware finished tranmission (TXC is set).
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+size_t HardwareSerialT<RX_SIZE, TX_SIZE>::write(uint8_t c)
+{
+  _written = true;
+  // If the buffer and the data register is empty, just write the byte
+  // to the data register and be done. This shortcut helps
+  // significantly improve the effective datarate at high (>
+  // 500kbit/s) bitrates, where interrupt overhead becomes a slowdown.
+  if (_tx_buffer_head == _serial_index_load(_tx_buffer_tail) && bit_is_set(*_ucsra, UDRE0)) {
+    // Writing UDR and clearing TXC must not be split by the TX complete
+    // interrupt, it would release the driver enable pin under this byte.
+    uint8_t oldSREG = SREG;
+    cli();
+    if (_de_mask)
+      *_de_port |= _de_mask;
+    *_udr = c;
+    sbi(*_ucsra, TXC0);
+    SREG = oldSREG;
+#if SERIAL_STATS
+    _stats.tx_bytes++;
+#endif
+    return 1;
+  }
+  tx_buffer_index_t i = (_tx_buffer_head + 1) % TX_SIZE;
+
+  // If the output buffer is full, there's nothing for it other than to
+  // wait for the interrupt handler to empty it a bit
+  while (i == _serial_index_load(_tx_buffer_tail)) {
+    if (bit_is_clear(SREG, SREG_I)) {
+      // Interrupts are disabled, so we'll have to poll the data
+      // register empty flag ourselves. If it is set, pretend an
+      // interrupt has happened and call the handler to free up
+      // space for us.
+      if(bit_is_set(*_ucsra, UDRE0))
+	_tx_udr_empty_irq();
+    } else {
+      // nop, the interrupt handler will free up space for us
+    }
+  }
+
+  _tx_buffer[_tx_buffer_head] = c;
+
+  // Same as write(buffer, size): the TX complete interrupt writes the
+  // port of the driver enable pin too, so set it with interrupts off.
+  uint8_t oldSREG = SREG;
+  cli();
+  _tx_buffer_head = i;
+  if (_de_mask)
+    *_de_port |= _de_mask;
+  sbi(*_ucsrb, UDRIE0);
+  SREG = oldSREG;
+#if SERIAL_STATS
+  _tx_stats(1);
+#endif
+
+  return 1;
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+size_t HardwareSerialT<RX_SIZE, TX_SIZE>::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+
+  if (size == 0)
+    return 0;
+
+  _written = true;
+  // Same shortcut as write(uint8_t): if nothing is queued and the data
+  // register is empty, the first byte can go straight out.
+  if (_tx_buffer_head == _serial_index_load(_tx_buffer_tail) && bit_is_set(*_ucsra, UDRE0)) {
+    uint8_t oldSREG = SREG;
+    cli();
+    if (_de_mask)
+      *_de_port |= _de_mask;
+    *_udr = *buffer;
+    sbi(*_ucsra, TXC0);
+    SREG = oldSREG;
+    n = 1;
+#if SERIAL_STATS
+    _stats.tx_bytes++;
+#endif
+  }
+
+  while (n < size) {
+    tx_buffer_index_t head = _tx_buffer_head;
+    tx_buffer_index_t tail = _serial_index_load(_tx_buffer_tail);
+
+    // Room between head and the end of the buffer or the slot just
+    // before tail, whichever comes first. One slot is always kept free
+    // so that head == tail means empty.
+    size_t room;
+    if (head >= tail) {
+      room = TX_SIZE - head;
+      if (tail == 0)
+        room--;
+    } else {
+      room = tail - head - 1;
+    }
+
+    if (room == 0) {
+      if (_tx_policy == SERIAL_TX_NONBLOCK)
+        break;
+      // Buffer full, wait for the interrupt handler to empty it a bit.
+      // When interrupts are disabled, poll the data register empty flag
+      // and call the handler ourselves, like write(uint8_t) does.
+      if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsra, UDRE0))
+        _tx_udr_empty_irq();
+      continue;
+    }
+
+    if (room > size - n)
+      room = size - n;
+    memcpy(_tx_buffer + head, buffer + n, room);
+    n += room;
+    head += room;
+    if (head == TX_SIZE)
+      head = 0;
+
+    // Publish the new head and arm the data register empty interrupt in
+    // one go, so the ISR never sees a half-updated head and never runs
+    // between the two and disables itself on a non-empty buffer.
+    uint8_t oldSREG = SREG;
+    cli();
+    _tx_buffer_head = head;
+    if (_de_mask)
+      *_de_port |= _de_mask;
+    sbi(*_ucsrb, UDRIE0);
+    SREG = oldSREG;
+#if SERIAL_STATS
+    _tx_stats(room);
+#endif
+  }
+
+  return n;
+}
+
+template<unsigned int RX_SIZE, unsigned int TX_SIZE>
+size_t HardwareSerialT<RX_SIZE, TX_SIZE>::writeAddress(uint8_t address)
+{
+  _written = true;
+  // The 9th bit is taken from TXB8 when the byte moves from the data
+  // register to the shift register, so the address can't be queued
+  // behind other bytes. Wait for the queue and the data register to
+  // drain first.
+  while (bit_is_set(*_ucsrb, UDRIE0) || bit_is_clear(*_ucsra, UDRE0)) {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsrb, UDRIE0) && bit_is_set(*_ucsra, UDRE0))
+      _tx_udr_empty_irq();
+  }
+
+  uint8_t oldSREG = SREG;
+  cli();
+  *_ucsrb |= _BV(UCSZ02) | _BV(TXB80);
+  if (_de_mask)
+    *_de_port |= _de_mask;
+  *_udr = address;
+  sbi(*_ucsra, TXC0);
+  SREG = oldSREG;
+#if SERIAL_STATS
+  _stats.tx_bytes++;
+#endif
+
+  // Once the data register is empty again, the address is in the shift
+  // register and the bytes that follow are data.
+  while (bit_is_clear(*_ucsra, UDRE0))
+    ;
+  oldSREG = SREG;
+  cli();
+  cbi(*_ucsrb, TXB80);
+  SREG = oldSREG;
+  return 1;
+}
+
+#endif
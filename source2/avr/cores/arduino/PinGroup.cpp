@@ -0,0 +1,152 @@
+/*
+  PinGroup.cpp - Write or read up to eight pins at the same time
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "PinGroup.h"
+
+bool PinGroup::begin(const uint8_t *pins, uint8_t count)
+{
+  uint8_t port_of[PIN_GROUP_MAX_PINS];
+  uint8_t ports[PIN_GROUP_MAX_PINS];
+  uint8_t nports = 0;
+  uint8_t i, j, v;
+
+  end();
+  if (count > PIN_GROUP_MAX_PINS)
+    return false;
+
+  for (i = 0; i < count; i++) {
+    uint8_t port = digitalPinToPort(pins[i]);
+    if (port == NOT_A_PIN)
+      return false;
+    for (j = 0; j < nports && ports[j] != port; j++)
+      ;
+    if (j == nports)
+      ports[nports++] = port;
+    port_of[i] = j;
+  }
+
+  if (nports) {
+    _ports = (PinGroupPort *)calloc(nports, sizeof(PinGroupPort));
+    if (_ports == 0)
+      return false;
+  }
+
+  for (j = 0; j < nports; j++) {
+    _ports[j].out = portOutputRegister(ports[j]);
+    _ports[j].in = portInputRegister(ports[j]);
+    _ports[j].ddr = portModeRegister(ports[j]);
+  }
+
+  for (i = 0; i < count; i++) {
+    PinGroupPort *p = &_ports[port_of[i]];
+    uint8_t bit = digitalPinToBitMask(pins[i]);
+    // Which half of the value this pin is in, and which half of the port.
+    uint8_t vhalf = i >> 2, vbit = 1 << (i & 3);
+    uint8_t phalf = bit >= 0x10, pbit = phalf ? bit >> 4 : bit;
+
+    p->mask |= bit;
+    for (v = 0; v < 16; v++) {
+      if (v & vbit)
+        p->scatter[vhalf][v] |= bit;
+      if (v & pbit)
+        p->gather[phalf][v] |= 1 << i;
+    }
+    _pins[i] = pins[i];
+  }
+
+  _nports = nports;
+  _count = count;
+  return true;
+}
+
+
+void PinGroup::end(void)
+{
+  free(_ports);
+  _ports = 0;
+  _nports = 0;
+  _count = 0;
+}
+
+
+void PinGroup::output(void)
+{
+  uint8_t i;
+
+  // A digitalWrite() of the level a pin already has turns its PWM off.
+  for (i = 0; i < _count; i++) {
+    if (digitalPinToTimer(_pins[i]) != NOT_ON_TIMER)
+      digitalWrite(_pins[i], (*portOutputRegister(digitalPinToPort(_pins[i])) & digitalPinToBitMask(_pins[i])) ? HIGH : LOW);
+  }
+
+  uint8_t oldSREG = SREG;
+  cli();
+  for (i = 0; i < _nports; i++)
+    *_ports[i].ddr |= _ports[i].mask;
+  SREG = oldSREG;
+}
+
+
+void PinGroup::input(void)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < _nports; i++) {
+    *_ports[i].ddr &= ~_ports[i].mask;
+    *_ports[i].out &= ~_ports[i].mask;
+  }
+  SREG = oldSREG;
+}
+
+
+void PinGroup::write(uint8_t value)
+{
+  uint8_t bits[PIN_GROUP_MAX_PINS];
+  uint8_t lo = value & 0x0F, hi = value >> 4;
+  uint8_t i;
+
+  // Do the lookups first, to keep the time with interrupts off and the
+  // time between the ports as short as possible.
+  for (i = 0; i < _nports; i++)
+    bits[i] = _ports[i].scatter[0][lo] | _ports[i].scatter[1][hi];
+
+  uint8_t oldSREG = SREG;
+  cli();
+  for (i = 0; i < _nports; i++)
+    *_ports[i].out = (*_ports[i].out & ~_ports[i].mask) | bits[i];
+  SREG = oldSREG;
+}
+
+
+uint8_t PinGroup::read(void)
+{
+  uint8_t sample[PIN_GROUP_MAX_PINS];
+  uint8_t value = 0;
+  uint8_t i;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  for (i = 0; i < _nports; i++)
+    sample[i] = *_ports[i].in;
+  SREG = oldSREG;
+
+  for (i = 0; i < _nports; i++)
+    value |= _ports[i].gather[0][sample[i] & 0x0F] | _ports[i].gather[1][sample[i] >> 4];
+  return value;
+}
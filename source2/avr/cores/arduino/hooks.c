@@ -16,16 +16,24 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+void serialEventDispatch(void) __attribute__((weak));
+void schedulerRun(void) __attribute__((weak));
+void softTimerRun(void) __attribute__((weak));
+
 /**
- * Empty yield() hook.
+ * Default yield() hook.
  *
  * This function is intended to be used by library writers to build
  * libraries or sketches that supports cooperative threads.
  *
  * Its defined as a weak symbol and it can be redefined to implement a
- * real cooperative scheduler.
+ * real cooperative scheduler. By default it runs the serial onReceive()
+ * handlers, the scheduler tasks and the deferred SoftTimer callbacks,
+ * when a sketch has any.
  */
-static void __empty() {
-	// Empty
+static void __yield() {
+	if (serialEventDispatch) serialEventDispatch();
+	if (schedulerRun) schedulerRun();
+	if (softTimerRun) softTimerRun();
 }
-void yield(void) __attribute__ ((weak, alias("__empty")));
+void yield(void) __attribute__ ((weak, alias("__yield")));
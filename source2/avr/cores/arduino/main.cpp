@@ -30,6 +30,74 @@ void initVariant() { }
 void setupUSB() __attribute__((weak));
 void setupUSB() { }
 
+#if defined(RAM_REPORT)
+// Everything between the end of .bss and the top of RAM is filled with
+// this pattern before the C runtime touches the stack, so ramReport()
+// can tell how deep the stack has been by finding the lowest byte that
+// no longer holds it.
+#define RAM_PAINT 0xC5
+
+extern uint8_t __data_start, __data_end, __bss_start, __bss_end, _end;
+extern "C" char *__brkval;
+
+// Runs from the .init3 section, before main() and with SP still at RAMEND.
+// Naked and in assembler since there is no stack frame to use yet.
+static void ramPaint(void) __attribute__((naked, used, section(".init3")));
+static void ramPaint(void)
+{
+	__asm__ __volatile__ (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(%1)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(%1)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:: "M" (RAM_PAINT), "i" (RAMEND)
+		: "r24", "r25", "r30", "r31");
+}
+
+void ramReport(Print &out)
+{
+	uint8_t *heap_end = __brkval ? (uint8_t *)__brkval : (uint8_t *)__malloc_heap_start;
+	uint8_t *sp = (uint8_t *)SP;
+
+	// The heap only grows up to __brkval, so anything above it that is
+	// not paint anymore was written by the stack.
+	uint8_t *low = heap_end;
+	while (low <= sp && *low == RAM_PAINT)
+		low++;
+
+	HeapStats heap;
+	heapStats(heap);
+
+	out.print(F("data "));
+	out.println(&__data_end - &__data_start);
+	out.print(F("bss "));
+	out.println(&__bss_end - &__bss_start);
+	out.print(F("heap "));
+	out.print(heap.size);
+	out.print(F(" used "));
+	out.print(heap.used);
+	out.print(F(" free "));
+	out.print(heap.free);
+	out.print(F(" largest "));
+	out.print(heap.largest);
+	out.print(F(" frag "));
+	out.print(heap.fragmentation);
+	out.println('%');
+	out.print(F("free "));
+	out.println(sp - heap_end);
+	out.print(F("stack "));
+	out.print(RAMEND - (uint16_t)sp);
+	out.print(F(" peak "));
+	out.println(RAMEND + 1 - (uint16_t)low);
+}
+#endif
+
 int main(void)
 {
 	init();
@@ -45,6 +113,9 @@ int main(void)
 	for (;;) {
 		loop();
 		if (serialEventRun) serialEventRun();
+		if (serialEventDispatch) serialEventDispatch();
+		if (schedulerRun) schedulerRun();
+		if (softTimerRun) softTimerRun();
 	}
         
 	return 0;
@@ -17,6 +17,7 @@
 */
 
 #include <stdlib.h>
+#include "new.h"
 
 void *operator new(size_t size) {
   return malloc(size);
@@ -34,3 +35,38 @@ void operator delete[](void * ptr) {
   free(ptr);
 }
 
+
+#if defined(RAM_REPORT)
+
+// avr-libc's malloc() keeps released blocks in this list, each one headed
+// by its size, not counting the size field itself. Blocks freed at the top
+// of the heap are given back by lowering __brkval instead.
+struct __freelist {
+  size_t sz;
+  struct __freelist *nx;
+};
+
+extern "C" {
+  extern struct __freelist *__flp;
+  extern char *__brkval;
+}
+
+void heapStats(HeapStats &stats)
+{
+  size_t free = 0, largest = 0;
+
+  for (struct __freelist *fp = __flp; fp; fp = fp->nx) {
+    size_t sz = fp->sz + sizeof(size_t);
+    free += sz;
+    if (sz > largest)
+      largest = sz;
+  }
+
+  stats.size = __brkval ? __brkval - __malloc_heap_start : 0;
+  stats.used = stats.size - free;
+  stats.free = free;
+  stats.largest = largest;
+  stats.fragmentation = free ? 100 - (uint32_t)largest * 100 / free : 0;
+}
+
+#endif
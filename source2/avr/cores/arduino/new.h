@@ -20,11 +20,24 @@
 #define NEW_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 void * operator new(size_t size);
 void * operator new[](size_t size);
 void operator delete(void * ptr);
 void operator delete[](void * ptr);
 
+#if defined(RAM_REPORT)
+struct HeapStats {
+  size_t size;     // bytes between the heap start and the break
+  size_t used;     // bytes in allocated blocks, size fields included
+  size_t free;     // bytes on the free list below the break
+  size_t largest;  // largest block on the free list
+  uint8_t fragmentation; // percent of the free list outside the largest block
+};
+
+void heapStats(HeapStats &stats);
+#endif
+
 #endif
 
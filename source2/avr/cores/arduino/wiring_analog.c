@@ -37,6 +37,7 @@ void analogReference(uint8_t mode)
 
 int analogRead(uint8_t pin)
 {
+	PROFILE_SCOPE(PROFILE_ID_ANALOG_READ);
 	uint8_t low, high;
 
 #if defined(analogPinToChannel)